@@ -100,6 +100,12 @@ GapsParameters getGapsParameters(const DataType &data, const Rcpp::List &allPara
     params.maxGibbsMassP = Rcpp::as<float>(gapsParams.slot("maxGibbsMassP"));
     params.useSparseOptimization = Rcpp::as<bool>(gapsParams.slot("sparseOptimization"));
     params.asynchronousUpdates = Rcpp::as<bool>(allParams["asynchronousUpdates"]);
+    params.speculativeQueue = Rcpp::as<bool>(allParams["speculativeQueue"]);
+    params.persistentThreads = Rcpp::as<bool>(allParams["persistentThreads"]);
+    params.pipelinedQueue = Rcpp::as<bool>(allParams["pipelinedQueue"]);
+    params.bfloat16Storage = Rcpp::as<bool>(allParams["bfloat16Storage"]);
+    params.trackChiSq = Rcpp::as<bool>(allParams["trackChiSq"]);
+    params.chiSqResyncFrequency = Rcpp::as<int>(allParams["chiSqResyncFrequency"]);
 
     // calculate snapshot frequency
     int nSnapshots = Rcpp::as<int>(allParams["nSnapshots"]);
@@ -176,6 +182,10 @@ const DataType &uncertainty)
             Rcpp::Named("meanPatternAssignment") = createRMatrix(result.meanPatternAssignment),
             Rcpp::Named("averageQueueLengthA") = result.averageQueueLengthA,
             Rcpp::Named("averageQueueLengthP") = result.averageQueueLengthP,
+            Rcpp::Named("queueLengthHistogramA") = Rcpp::wrap(result.queueLengthHistogramA),
+            Rcpp::Named("queueLengthHistogramP") = Rcpp::wrap(result.queueLengthHistogramP),
+            Rcpp::Named("conflictHistogramA") = Rcpp::wrap(result.conflictHistogramA),
+            Rcpp::Named("conflictHistogramP") = Rcpp::wrap(result.conflictHistogramP),
             Rcpp::Named("totalUpdates") = result.totalUpdates,
             Rcpp::Named("totalRunningTime") = result.totalRunningTime,
             Rcpp::Named("equilibrationSnapshotsA") = createListOfRMatrices(result.equilibrationSnapshotsA),
@@ -240,6 +250,16 @@ bool compiledWithOpenMPSupport_cpp()
 #endif
 }
 
+// [[Rcpp::export]]
+bool zlibEnabled_cpp()
+{
+#ifdef __GAPS_ZLIB__
+    return true;
+#else
+    return false;
+#endif
+}
+
 // [[Rcpp::export]]
 Rcpp::List getFileInfo_cpp(const std::string &path)
 {
@@ -17,9 +17,15 @@ void GapsParameters::print() const
     gaps_printf("printMessages: %s\n", printMessages ? "TRUE" : "FALSE");
     gaps_printf("outputFrequency: %d\n", outputFrequency);
     gaps_printf("snapshotFrequency: %d\n", snapshotFrequency);
+    gaps_printf("trackChiSq: %s\n", trackChiSq ? "TRUE" : "FALSE");
+    gaps_printf("chiSqResyncFrequency: %d\n", chiSqResyncFrequency);
     gaps_printf("\n");
     gaps_printf("useSparseOptimization: %s\n", useSparseOptimization ? "TRUE" : "FALSE");
     gaps_printf("asynchronousUpdates: %s\n", asynchronousUpdates ? "TRUE" : "FALSE");
+    gaps_printf("speculativeQueue: %s\n", speculativeQueue ? "TRUE" : "FALSE");
+    gaps_printf("persistentThreads: %s\n", persistentThreads ? "TRUE" : "FALSE");
+    gaps_printf("pipelinedQueue: %s\n", pipelinedQueue ? "TRUE" : "FALSE");
+    gaps_printf("bfloat16Storage: %s\n", bfloat16Storage ? "TRUE" : "FALSE");
     gaps_printf("takePumpSamples: %s\n", takePumpSamples ? "TRUE" : "FALSE");
     gaps_printf("\n");
     gaps_printf("runningDistributed: %s\n", runningDistributed ? "TRUE" : "FALSE");
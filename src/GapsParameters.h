@@ -44,6 +44,7 @@ public:
     unsigned outputFrequency;
     unsigned checkpointInterval;
     unsigned snapshotFrequency;
+    unsigned chiSqResyncFrequency;
     float alphaA;
     float alphaP;
     float maxGibbsMassA;
@@ -60,6 +61,11 @@ public:
     bool useSparseOptimization;
     bool takePumpSamples;
     bool asynchronousUpdates;
+    bool speculativeQueue;
+    bool persistentThreads;
+    bool pipelinedQueue;
+    bool bfloat16Storage;
+    bool trackChiSq;
     char whichMatrixFixed;
     unsigned workerID;
     bool runningDistributed;
@@ -89,6 +95,7 @@ maxThreads(1),
 outputFrequency(500),
 checkpointInterval(250),
 snapshotFrequency(0),
+chiSqResyncFrequency(100),
 alphaA(0.01f),
 alphaP(0.01f),
 maxGibbsMassA(100.f),
@@ -105,6 +112,11 @@ printThreadUsage(true),
 useSparseOptimization(false),
 takePumpSamples(false),
 asynchronousUpdates(true),
+speculativeQueue(false),
+persistentThreads(false),
+pipelinedQueue(false),
+bfloat16Storage(false),
+trackChiSq(false),
 whichMatrixFixed('N'),
 workerID(1),
 runningDistributed(false)
@@ -27,6 +27,10 @@ struct GapsResult
     std::vector<float> chisqHistory;
     std::vector<unsigned> atomHistoryA;
     std::vector<unsigned> atomHistoryP;
+    std::vector<uint64_t> queueLengthHistogramA;
+    std::vector<uint64_t> queueLengthHistogramP;
+    std::vector<uint64_t> conflictHistogramA;
+    std::vector<uint64_t> conflictHistogramP;
     uint64_t totalUpdates;
     uint32_t seed;
     unsigned totalRunningTime;
@@ -54,15 +54,15 @@ struct GapsTime
 };
 
 // forward declaration
-template <class Sampler, class DataType>
+template <class Sampler, class DataType, class UncertaintyType>
 static GapsResult runCoGAPSAlgorithm(const DataType &data, GapsParameters &params,
-    const DataType &uncertainty, GapsRandomState *randState);
+    const UncertaintyType &uncertainty, GapsRandomState *randState);
 
 ////////////////////////////////////////////////////////////////////////////////
 
-template <class DataModel, class DataType>
+template <class DataModel, class DataType, class UncertaintyType>
 static GapsResult chooseSampler(const DataType &data, GapsParameters &params,
-const DataType &uncertainty, GapsRandomState *randState)
+const UncertaintyType &uncertainty, GapsRandomState *randState)
 {
     if (params.asynchronousUpdates)
     {
@@ -85,7 +85,10 @@ const DataType &uncertainty, GapsRandomState *randState)
         return chooseSampler<SparseNormalModel>(data, params, uncertainty, randState);
     }
     GAPS_MESSAGE(params.printMessages, "Data Model: Dense, Normal\n");        
-    return chooseSampler<DenseNormalModel>(data, params, uncertainty, randState);
+
+    // both samplers read the data from the same store
+    SharedDenseData sharedData(new DenseDataStore(data, params, true));
+    return chooseSampler<DenseNormalModel>(sharedData, params, uncertainty, randState);
 }
 
 // helper function, this dispatches the correct run function depending
@@ -152,17 +155,31 @@ const Sampler &ASampler, const Sampler &PSampler, GapsAlgorithmPhase phase, unsi
     return estimatedCompleted / estimatedTotal;
 }
 
+// the sampler of a fixed matrix is never synced, so chi-square comes from the
+// other sampler which always has the current AP and lookup tables
+template <class Sampler>
+static float currentChiSq(const GapsParameters &params, const Sampler &ASampler,
+const Sampler &PSampler)
+{
+    return params.whichMatrixFixed == 'P' ? ASampler.chiSq(params.maxThreads)
+        : PSampler.chiSq(params.maxThreads);
+}
+
 template <class Sampler>
 static void displayStatus(const GapsParameters &params,
 const Sampler &ASampler, const Sampler &PSampler, bpt::ptime startTime,
-GapsAlgorithmPhase phase, unsigned iter, GapsStatistics &stats)
+GapsAlgorithmPhase phase, unsigned iter, GapsStatistics &stats, double runningChiSq)
 {
     if (params.outputFrequency > 0 && ((iter + 1) % params.outputFrequency) == 0)
     {
-        float cs = PSampler.chiSq();
+        float cs = params.trackChiSq ? static_cast<float>(runningChiSq)
+            : currentChiSq(params, ASampler, PSampler);
         unsigned nA = ASampler.nAtoms();
         unsigned nP = PSampler.nAtoms();
-        stats.addChiSq(cs);
+        if (!params.trackChiSq)
+        {
+            stats.addChiSq(cs);
+        }
         stats.addAtomCount(nA, nP);
         if (params.printMessages)
         {
@@ -205,6 +222,24 @@ Sampler &PSampler, unsigned nA, unsigned nP)
     }
 }
 
+// the samplers accumulate the change in chi-square from every change they
+// make, so it can be recorded each iteration without recomputing it, it is
+// still recomputed periodically so that rounding errors don't build up
+template <class Sampler>
+static void trackChiSq(const GapsParameters &params, Sampler &ASampler,
+Sampler &PSampler, unsigned iter, GapsStatistics &stats, double &runningChiSq)
+{
+    if (params.trackChiSq)
+    {
+        runningChiSq += ASampler.takeChiSqChange() + PSampler.takeChiSqChange();
+        if (params.chiSqResyncFrequency > 0 && ((iter + 1) % params.chiSqResyncFrequency) == 0)
+        {
+            runningChiSq = currentChiSq(params, ASampler, PSampler);
+        }
+        stats.addChiSq(static_cast<float>(runningChiSq));
+    }
+}
+
 template <class Sampler>
 static void createCheckpoint(const GapsParameters &params,
 Sampler &ASampler, Sampler &PSampler, const GapsRandomState *randState,
@@ -231,8 +266,8 @@ const GapsStatistics &stats, const GapsRng &rng, GapsAlgorithmPhase phase, unsig
         // thing once a checkpoint is loaded since large matrices which aren't stored
         // need to be initialized. By running it here we make sure that the algorithm
         // is in the same state it will be when started from a checkpoint
-        ASampler.extraInitialization();
-        PSampler.extraInitialization();
+        ASampler.extraInitialization(params.maxThreads);
+        PSampler.extraInitialization(params.maxThreads);
     }
 }
 
@@ -256,7 +291,8 @@ GapsRng &rng, GapsAlgorithmPhase &phase, unsigned &currentIter)
 template <class Sampler>
 static uint64_t runOnePhase(const GapsParameters &params, Sampler &ASampler,
 Sampler &PSampler, GapsStatistics &stats, const GapsRandomState *randState,
-GapsRng &rng, bpt::ptime startTime, GapsAlgorithmPhase phase, unsigned &currentIter)
+GapsRng &rng, bpt::ptime startTime, GapsAlgorithmPhase phase, unsigned &currentIter,
+double &runningChiSq)
 {
     uint64_t totalUpdates = 0;
     for (; currentIter < params.nIterations; ++currentIter)
@@ -279,6 +315,7 @@ GapsRng &rng, bpt::ptime startTime, GapsAlgorithmPhase phase, unsigned &currentI
         unsigned nP = rng.poisson(gaps::max(PSampler.nAtoms(), 10));
         updateSampler(params, ASampler, PSampler, nA, nP);
         totalUpdates += nA + nP;
+        trackChiSq(params, ASampler, PSampler, currentIter, stats, runningChiSq);
 
         if (phase == GAPS_SAMPLING_PHASE)
         {
@@ -296,7 +333,7 @@ GapsRng &rng, bpt::ptime startTime, GapsAlgorithmPhase phase, unsigned &currentI
             }
         }
         displayStatus(params, ASampler, PSampler, startTime, phase,
-            currentIter, stats);
+            currentIter, stats, runningChiSq);
     }
     return totalUpdates;
 }
@@ -353,9 +390,9 @@ Sampler &PSampler, const DataType &uncertainty)
 }
 
 // here is the CoGAPS algorithm
-template <class Sampler, class DataType>
+template <class Sampler, class DataType, class UncertaintyType>
 static GapsResult runCoGAPSAlgorithm(const DataType &data, GapsParameters &params,
-const DataType &uncertainty, GapsRandomState *randState)
+const UncertaintyType &uncertainty, GapsRandomState *randState)
 {
     // check if running in debug mode
     #ifdef GAPS_DEBUG
@@ -418,8 +455,9 @@ const DataType &uncertainty, GapsRandomState *randState)
     // sync samplers and run any additional initialization needed
     ASampler.sync(PSampler);
     PSampler.sync(ASampler);
-    ASampler.extraInitialization();
-    PSampler.extraInitialization();
+    ASampler.extraInitialization(params.maxThreads);
+    PSampler.extraInitialization(params.maxThreads);
+    double runningChiSq = params.trackChiSq ? currentChiSq(params, ASampler, PSampler) : 0.0;
 
     // record start time
     bpt::ptime startTime = bpt_now();
@@ -432,22 +470,26 @@ const DataType &uncertainty, GapsRandomState *randState)
         case GAPS_EQUILIBRATION_PHASE:
             GAPS_MESSAGE(params.printMessages, "-- Equilibration Phase --\n");
             totalUpdates += runOnePhase(params, ASampler, PSampler, stats, randState,
-                rng, startTime, phase, currentIter);
+                rng, startTime, phase, currentIter, runningChiSq);
             phase = GAPS_SAMPLING_PHASE;
             currentIter = 0;
         // fall through
         case GAPS_SAMPLING_PHASE:
             GAPS_MESSAGE(params.printMessages, "-- Sampling Phase --\n");
             totalUpdates += runOnePhase(params, ASampler, PSampler, stats, randState,
-                rng, startTime, phase, currentIter);
+                rng, startTime, phase, currentIter, runningChiSq);
     }
     
     // get result
     GapsResult result(stats);
     result.totalRunningTime = static_cast<unsigned>((bpt_now() - startTime).total_seconds());
-    result.meanChiSq = stats.meanChiSq(PSampler);
+    result.meanChiSq = stats.meanChiSq(PSampler, params.maxThreads);
     result.averageQueueLengthA = ASampler.getAverageQueueLength();
     result.averageQueueLengthP = PSampler.getAverageQueueLength();
+    result.queueLengthHistogramA = ASampler.queueLengthHistogram();
+    result.queueLengthHistogramP = PSampler.queueLengthHistogram();
+    result.conflictHistogramA = ASampler.conflictHistogram();
+    result.conflictHistogramP = PSampler.conflictHistogram();
     result.totalUpdates = totalUpdates;
 
     // handle pump statistics
@@ -60,54 +60,138 @@ Matrix GapsStatistics::Psd() const
     return mat;
 }
 
-float GapsStatistics::meanChiSq(const DenseNormalModel &model) const
+// Amean * Pmean^T for the samples in [first, first + n), the mean matrices
+// are only multiplied for a few samples at a time so there is never a second
+// matrix the size of the data
+Matrix GapsStatistics::meanAPBlock(unsigned first, unsigned n, unsigned nThreads) const
 {
-    GAPS_ASSERT(model.mDMatrix.nRow() == mAMeanMatrix.nRow());
-    GAPS_ASSERT(model.mDMatrix.nCol() == mPMeanMatrix.nRow());
+    Matrix PBlock(n, mNumPatterns);
+    for (unsigned k = 0; k < mNumPatterns; ++k)
+    {
+        for (unsigned j = 0; j < n; ++j)
+        {
+            PBlock(j,k) = mPMeanMatrix(first + j, k);
+        }
+    }
+    Matrix M(mAMeanMatrix.nRow(), n);
+    gaps::multiplyTransposed(mAMeanMatrix, PBlock, &M, nThreads);
+    return M / GAPS_SQ(static_cast<float>(mStatUpdates));
+}
 
-    float chisq = 0.f;
-    for (unsigned i = 0; i < model.mDMatrix.nRow(); ++i)
+// each sample is summed separately and then added in order, so the result
+// doesn't depend on the number of threads
+float GapsStatistics::meanChiSq(const DenseNormalModel &model, unsigned nThreads) const
+{
+    GAPS_ASSERT(model.mAPMatrix.nRow() == mAMeanMatrix.nRow());
+    GAPS_ASSERT(model.mAPMatrix.nCol() == mPMeanMatrix.nRow());
+
+    unsigned nGenes = mAMeanMatrix.nRow();
+    unsigned nSamples = mPMeanMatrix.nRow();
+    std::vector<float> sampleChisq(nSamples, 0.f);
+    for (unsigned first = 0; first < nSamples; first += GAPS_CHISQ_BLOCK)
     {
-        for (unsigned j = 0; j < model.mDMatrix.nCol(); ++j)
+        unsigned n = gaps::min(nSamples - first, static_cast<unsigned>(GAPS_CHISQ_BLOCK));
+        Matrix M(meanAPBlock(first, n, nThreads));
+        #pragma omp parallel for num_threads(nThreads)
+        for (unsigned j = 0; j < n; ++j)
         {
-            float m = 0.f;
-            for (unsigned k = 0; k < mAMeanMatrix.nCol(); ++k)
+            for (unsigned i = 0; i < nGenes; ++i)
             {
-                m += mAMeanMatrix(i,k) * mPMeanMatrix(j,k);
+                float d = model.dataValue(i, first + j);
+                sampleChisq[first + j] += GAPS_SQ(d - M(i,j))
+                    * model.invSSqValue(i, first + j);
             }
-            m /= GAPS_SQ(static_cast<float>(mStatUpdates));
-
-            float d = model.mDMatrix(i,j);
-            float s = model.mSMatrix(i,j);
-            chisq += GAPS_SQ(d - m) / GAPS_SQ(s);
         }
     }
+
+    float chisq = 0.f;
+    for (unsigned j = 0; j < nSamples; ++j)
+    {
+        chisq += sampleChisq[j];
+    }
     return chisq;
 }
 
-float GapsStatistics::meanChiSq(const SparseNormalModel &model) const
+// Every zero of the data has uncertainty 0.1, even with a user supplied
+// uncertainty, so the zeros of a sample contribute 100 times the sum of M^2
+// over the whole sample minus the sum at the non-zeros. The sum over the whole
+// sample j is p_j^T (Amean^T Amean) p_j, so only the non-zeros need the mean
+// AP. Each sample is summed separately in double precision and then added in
+// order, so the result doesn't depend on the number of threads.
+float GapsStatistics::meanChiSq(const SparseNormalModel &model, unsigned nThreads) const
 {
     GAPS_ASSERT(model.mDMatrix.nRow() == mAMeanMatrix.nRow());
     GAPS_ASSERT(model.mDMatrix.nCol() == mPMeanMatrix.nRow());
 
-    float chisq = 0.f;
-    for (unsigned i = 0; i < model.mDMatrix.nRow(); ++i)
+    unsigned nGenes = mAMeanMatrix.nRow();
+    unsigned nSamples = mPMeanMatrix.nRow();
+    double scale = 1.0 / GAPS_SQ(static_cast<double>(mStatUpdates));
+
+    // Amean^T Amean, and Amean^T so each gene is contiguous
+    std::vector<double> gram(mNumPatterns * mNumPatterns, 0.0);
+    for (unsigned p = 0; p < mNumPatterns; ++p)
     {
-        for (unsigned j = 0; j < model.mDMatrix.nCol(); ++j)
+        for (unsigned q = p; q < mNumPatterns; ++q)
         {
-            float m = 0.f;
-            for (unsigned k = 0; k < mAMeanMatrix.nCol(); ++k)
+            double sum = 0.0;
+            for (unsigned i = 0; i < nGenes; ++i)
             {
-                m += mAMeanMatrix(i,k) * mPMeanMatrix(j,k);
+                sum += static_cast<double>(mAMeanMatrix(i,p)) * mAMeanMatrix(i,q);
             }
-            m /= GAPS_SQ(static_cast<float>(mStatUpdates));
+            gram[p * mNumPatterns + q] = sum;
+        }
+    }
+    Matrix At(mNumPatterns, nGenes);
+    gaps::transpose(mAMeanMatrix, &At, nThreads);
 
-            float d = model.mDMatrix.getCol(j).at(i);
-            float s = gaps::max(d * 0.1f, 0.1f);
-            chisq += GAPS_SQ(d - m) / GAPS_SQ(s);
+    std::vector<double> sampleChisq(nSamples, 0.0);
+    #pragma omp parallel for num_threads(nThreads)
+    for (unsigned j = 0; j < nSamples; ++j)
+    {
+        std::vector<float> p(mNumPatterns);
+        for (unsigned k = 0; k < mNumPatterns; ++k)
+        {
+            p[k] = mPMeanMatrix(j,k);
         }
+
+        double sumSq = 0.0;
+        for (unsigned a = 0; a < mNumPatterns; ++a)
+        {
+            double cross = 0.0;
+            for (unsigned b = a + 1; b < mNumPatterns; ++b)
+            {
+                cross += gram[a * mNumPatterns + b] * p[b];
+            }
+            sumSq += p[a] * (gram[a * mNumPatterns + a] * p[a] + 2.0 * cross);
+        }
+        double chisq = 100.0 * sumSq * GAPS_SQ(scale);
+
+        const SparseVector &D(model.mDMatrix.getCol(j));
+        const std::vector<unsigned> &indices(D.getIndices());
+        const std::vector<float> &data(D.getData());
+        for (unsigned n = 0; n < indices.size(); ++n)
+        {
+            const float *a = At.getCol(indices[n]).ptr();
+            double m = 0.0;
+            for (unsigned k = 0; k < mNumPatterns; ++k)
+            {
+                m += static_cast<double>(a[k]) * p[k];
+            }
+            m *= scale;
+            double invSSq = model.mDefaultUncertainty
+                ? 1.0 / GAPS_SQ(gaps::max(data[n] * 0.1f, 0.1f))
+                : model.mBeta * model.mWeightNonZero[j][n];
+            chisq += GAPS_SQ(data[n] - m) * invSSq - 100.0 * GAPS_SQ(m);
+        }
+        sampleChisq[j] = chisq;
     }
-    return chisq;
+
+    double chisq = 0.0;
+    for (unsigned j = 0; j < nSamples; ++j)
+    {
+        chisq += sampleChisq[j];
+    }
+    return static_cast<float>(chisq);
 }
 
 Matrix GapsStatistics::pumpMatrix() const
@@ -11,6 +11,9 @@
 
 #define GAPS_SQ(x) ((x) * (x))
 
+// number of samples meanChiSq works on at a time
+#define GAPS_CHISQ_BLOCK 256
+
 class Archive;
 
 class GapsStatistics
@@ -33,13 +36,15 @@ public:
     void addAtomCount(unsigned atomA, unsigned atomP);
     std::vector<float> chisqHistory() const;
     std::vector<unsigned> atomHistory(char m) const;
-    float meanChiSq(const DenseNormalModel &model) const;
-    float meanChiSq(const SparseNormalModel &model) const;
+    float meanChiSq(const DenseNormalModel &model, unsigned nThreads=1) const;
+    float meanChiSq(const SparseNormalModel &model, unsigned nThreads=1) const;
     const std::vector<Matrix>& getEquilibrationSnapshots(char whichMatrix) const;
     const std::vector<Matrix>& getSamplingSnapshots(char whichMatrix) const;
     friend Archive& operator<<(Archive &ar, const GapsStatistics &stat);
     friend Archive& operator>>(Archive &ar, GapsStatistics &stat);
 private:
+    Matrix meanAPBlock(unsigned first, unsigned n, unsigned nThreads) const;
+
     Matrix mAMeanMatrix;
     Matrix mAStdMatrix;
     Matrix mPMeanMatrix;
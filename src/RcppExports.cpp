@@ -61,6 +61,16 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// zlibEnabled_cpp
+bool zlibEnabled_cpp();
+RcppExport SEXP _CoGAPS_zlibEnabled_cpp() {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    rcpp_result_gen = Rcpp::wrap(zlibEnabled_cpp());
+    return rcpp_result_gen;
+END_RCPP
+}
 // getFileInfo_cpp
 Rcpp::List getFileInfo_cpp(const std::string& path);
 RcppExport SEXP _CoGAPS_getFileInfo_cpp(SEXP pathSEXP) {
@@ -89,6 +99,7 @@ static const R_CallMethodDef CallEntries[] = {
     {"_CoGAPS_getBuildReport_cpp", (DL_FUNC) &_CoGAPS_getBuildReport_cpp, 0},
     {"_CoGAPS_checkpointsEnabled_cpp", (DL_FUNC) &_CoGAPS_checkpointsEnabled_cpp, 0},
     {"_CoGAPS_compiledWithOpenMPSupport_cpp", (DL_FUNC) &_CoGAPS_compiledWithOpenMPSupport_cpp, 0},
+    {"_CoGAPS_zlibEnabled_cpp", (DL_FUNC) &_CoGAPS_zlibEnabled_cpp, 0},
     {"_CoGAPS_getFileInfo_cpp", (DL_FUNC) &_CoGAPS_getFileInfo_cpp, 1},
     {"_CoGAPS_run_catch_unit_tests", (DL_FUNC) &_CoGAPS_run_catch_unit_tests, 0},
     {NULL, NULL, 0}
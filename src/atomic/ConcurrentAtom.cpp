@@ -22,7 +22,7 @@ bool ConcurrentAtomNeighborhood::hasRight() const
 }
 
 ConcurrentAtom::ConcurrentAtom(uint64_t p, float m)
-    : mPos(p), mLeft(NULL), mRight(NULL), mIterator(), mIndex(0), mMass(m)
+    : mPos(p), mLeft(NULL), mRight(NULL), mMapHandle(), mIndex(0), mMass(m)
 {}
 
 uint64_t ConcurrentAtom::pos() const
@@ -80,9 +80,9 @@ void ConcurrentAtom::setIndex(unsigned index)
     mIndex = index;
 }
 
-void ConcurrentAtom::setIterator(ConcurrentAtomMapType::iterator it)
+void ConcurrentAtom::setMapHandle(ConcurrentAtomMapType::Handle handle)
 {
-    mIterator = it;
+    mMapHandle = handle;
 }
 
 unsigned ConcurrentAtom::index() const
@@ -90,9 +90,9 @@ unsigned ConcurrentAtom::index() const
     return mIndex;
 }
 
-ConcurrentAtomMapType::iterator ConcurrentAtom::iterator() const
+ConcurrentAtomMapType::Handle ConcurrentAtom::mapHandle() const
 {
-    return mIterator;
+    return mMapHandle;
 }
 
 Archive& operator<<(Archive &ar, const ConcurrentAtom &a)
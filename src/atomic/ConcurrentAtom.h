@@ -5,9 +5,8 @@ struct ConcurrentAtom;
 class ConcurrentAtomicDomain;
 class Archive;
 
-// this is the map used internally by the atomic domain
-#include "../data_structures/MutableMap.h"
-typedef MutableMap<uint64_t, ConcurrentAtom*> ConcurrentAtomMapType;
+// this is the ordered index used internally by the atomic domain
+#include "ConcurrentAtomMap.h"
 
 struct ConcurrentAtomNeighborhood
 {
@@ -37,18 +36,18 @@ public:
     void setLeft(ConcurrentAtom *atom);
     void setRight(ConcurrentAtom *atom);
     void setIndex(unsigned index);
-    void setIterator(ConcurrentAtomMapType::iterator it);    
+    void setMapHandle(ConcurrentAtomMapType::Handle handle);
     bool hasLeft() const;
     bool hasRight() const;
     ConcurrentAtom* left() const;
     ConcurrentAtom* right() const;
     unsigned index() const;
-    ConcurrentAtomMapType::iterator iterator() const;
+    ConcurrentAtomMapType::Handle mapHandle() const;
 
     uint64_t mPos;
     ConcurrentAtom *mLeft;
     ConcurrentAtom *mRight;
-    ConcurrentAtomMapType::iterator mIterator; // iterator to position in map
+    ConcurrentAtomMapType::Handle mMapHandle; // location of atom in the ordered index
     unsigned mIndex; // storing the index allows vector lookup once found in map
     float mMass;
 };
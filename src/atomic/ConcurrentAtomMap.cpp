@@ -0,0 +1,284 @@
+#include "ConcurrentAtomMap.h"
+#include "ConcurrentAtom.h"
+#include "../utils/GapsAssert.h"
+
+#include <algorithm>
+#include <cstddef>
+
+#ifdef GAPS_STD_MAP_ATOMIC_DOMAIN
+
+/////////////////////////// StdConcurrentAtomMap ///////////////////////////////
+
+StdConcurrentAtomMap::StdConcurrentAtomMap() : mMap(), mSize(0) {}
+
+StdConcurrentAtomMap::~StdConcurrentAtomMap() {}
+
+void StdConcurrentAtomMap::insert(ConcurrentAtom *atom, ConcurrentAtom **left,
+ConcurrentAtom **right)
+{
+    Handle it(mMap.insert(std::pair<uint64_t, ConcurrentAtom*>(atom->pos(), atom)).first);
+    atom->setMapHandle(it);
+    ++mSize;
+
+    Handle itRight(it);
+    *right = (++itRight != mMap.end()) ? (*itRight).second : NULL;
+    Handle itLeft(it);
+    *left = (itLeft != mMap.begin()) ? (*(--itLeft)).second : NULL;
+}
+
+void StdConcurrentAtomMap::erase(ConcurrentAtom *atom)
+{
+    mMap.erase(atom->mapHandle());
+    --mSize;
+}
+
+// safe to call concurrently from OpenMP threads
+void StdConcurrentAtomMap::updatePos(ConcurrentAtom *atom, uint64_t newPos)
+{
+    mMap.updateKey(atom->mapHandle(), newPos);
+}
+
+bool StdConcurrentAtomMap::contains(uint64_t pos) const
+{
+    return mMap.count(pos) != 0u;
+}
+
+ConcurrentAtom* StdConcurrentAtomMap::front() const
+{
+    GAPS_ASSERT(mSize > 0);
+    return (*mMap.begin()).second;
+}
+
+uint64_t StdConcurrentAtomMap::size() const
+{
+    return mSize;
+}
+
+#else
+
+/////////////////////////// BlockedConcurrentAtomMap ///////////////////////////
+
+ConcurrentAtomBlock::ConcurrentAtomBlock() : size(0) {}
+
+BlockedConcurrentAtomMap::BlockedConcurrentAtomMap() : mSize(0) {}
+
+BlockedConcurrentAtomMap::~BlockedConcurrentAtomMap()
+{
+    for (unsigned b = 0; b < mBlocks.size(); ++b)
+    {
+        delete mBlocks[b];
+    }
+}
+
+void BlockedConcurrentAtomMap::insert(ConcurrentAtom *atom, ConcurrentAtom **left,
+ConcurrentAtom **right)
+{
+    uint64_t pos = atom->pos();
+    if (mBlocks.empty())
+    {
+        mBlocks.push_back(new ConcurrentAtomBlock());
+        mFirstKeys.push_back(pos);
+    }
+
+    unsigned b = findBlock(pos);
+    if (mBlocks[b]->size == GAPS_ATOM_BLOCK_CAPACITY)
+    {
+        splitBlock(b);
+        b = (pos >= mBlocks[b + 1]->keys[0]) ? b + 1 : b;
+    }
+
+    // shift larger keys to the right to make room for this atom
+    ConcurrentAtomBlock *block = mBlocks[b];
+    unsigned i = std::lower_bound(block->keys, block->keys + block->size, pos) - block->keys;
+    GAPS_ASSERT(i == block->size || block->keys[i] != pos);
+    std::copy_backward(block->keys + i, block->keys + block->size, block->keys + block->size + 1);
+    std::copy_backward(block->atoms + i, block->atoms + block->size, block->atoms + block->size + 1);
+    block->keys[i] = pos;
+    block->atoms[i] = atom;
+    ++block->size;
+    ++mSize;
+    atom->setMapHandle(block);
+    if (i == 0)
+    {
+        mFirstKeys[b] = pos;
+    }
+
+    // neighbors are either in this block or at the edge of the adjacent block
+    if (i > 0)
+    {
+        *left = block->atoms[i - 1];
+    }
+    else
+    {
+        *left = (b > 0) ? mBlocks[b - 1]->atoms[mBlocks[b - 1]->size - 1] : NULL;
+    }
+    if (i + 1 < block->size)
+    {
+        *right = block->atoms[i + 1];
+    }
+    else
+    {
+        *right = (b + 1 < mBlocks.size()) ? mBlocks[b + 1]->atoms[0] : NULL;
+    }
+}
+
+void BlockedConcurrentAtomMap::erase(ConcurrentAtom *atom)
+{
+    unsigned b = findBlock(atom->pos());
+    ConcurrentAtomBlock *block = mBlocks[b];
+    GAPS_ASSERT(block == atom->mapHandle());
+    unsigned i = std::lower_bound(block->keys, block->keys + block->size, atom->pos()) - block->keys;
+    GAPS_ASSERT(i < block->size && block->atoms[i] == atom);
+    std::copy(block->keys + i + 1, block->keys + block->size, block->keys + i);
+    std::copy(block->atoms + i + 1, block->atoms + block->size, block->atoms + i);
+    --block->size;
+    --mSize;
+
+    if (block->size == 0)
+    {
+        removeBlock(b);
+        return;
+    }
+    if (i == 0)
+    {
+        mFirstKeys[b] = block->keys[0];
+    }
+
+    // keep blocks reasonably full so that the number of blocks stays small
+    if (block->size < GAPS_ATOM_BLOCK_CAPACITY / 4)
+    {
+        if (b + 1 < mBlocks.size()
+        && block->size + mBlocks[b + 1]->size <= GAPS_ATOM_BLOCK_CAPACITY / 2)
+        {
+            mergeWithNext(b);
+        }
+        else if (b > 0
+        && block->size + mBlocks[b - 1]->size <= GAPS_ATOM_BLOCK_CAPACITY / 2)
+        {
+            mergeWithNext(b - 1);
+        }
+    }
+}
+
+// safe to call concurrently from OpenMP threads, the atom is found by scanning
+// the atom pointers of its block, which are never written during concurrent
+// position updates, only the key belonging to this atom is changed
+void BlockedConcurrentAtomMap::updatePos(ConcurrentAtom *atom, uint64_t newPos)
+{
+    ConcurrentAtomBlock *block = atom->mapHandle();
+    for (unsigned i = 0; i < block->size; ++i)
+    {
+        if (block->atoms[i] == atom)
+        {
+            block->keys[i] = newPos;
+            return;
+        }
+    }
+    GAPS_ASSERT_MSG(false, "atom not found in block");
+}
+
+bool BlockedConcurrentAtomMap::contains(uint64_t pos) const
+{
+    if (mBlocks.empty())
+    {
+        return false;
+    }
+    const ConcurrentAtomBlock *block = mBlocks[findBlock(pos)];
+    return std::binary_search(block->keys, block->keys + block->size, pos);
+}
+
+ConcurrentAtom* BlockedConcurrentAtomMap::front() const
+{
+    GAPS_ASSERT(mSize > 0);
+    return mBlocks[0]->atoms[0];
+}
+
+uint64_t BlockedConcurrentAtomMap::size() const
+{
+    return mSize;
+}
+
+// find the last block whose first key is not greater than pos, or the first
+// block if pos is smaller than every key
+unsigned BlockedConcurrentAtomMap::findBlock(uint64_t pos) const
+{
+    GAPS_ASSERT(!mBlocks.empty());
+
+    // binary search on the hint, this is always a valid starting point even
+    // if some first keys are out of date
+    unsigned lo = 0;
+    unsigned hi = mFirstKeys.size();
+    while (hi - lo > 1)
+    {
+        unsigned mid = lo + (hi - lo) / 2;
+        if (mFirstKeys[mid] <= pos)
+        {
+            lo = mid;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    // correct for any position changes made since the hint was recorded
+    unsigned b = lo;
+    while (b > 0 && pos < mBlocks[b]->keys[0])
+    {
+        mFirstKeys[b] = mBlocks[b]->keys[0];
+        --b;
+    }
+    while (b + 1 < mBlocks.size() && mBlocks[b + 1]->keys[0] <= pos)
+    {
+        mFirstKeys[b + 1] = mBlocks[b + 1]->keys[0];
+        ++b;
+    }
+    mFirstKeys[b] = mBlocks[b]->keys[0];
+    return b;
+}
+
+// move the upper half of a block into a new block
+void BlockedConcurrentAtomMap::splitBlock(unsigned b)
+{
+    ConcurrentAtomBlock *block = mBlocks[b];
+    ConcurrentAtomBlock *next = new ConcurrentAtomBlock();
+    unsigned half = block->size / 2;
+    std::copy(block->keys + half, block->keys + block->size, next->keys);
+    std::copy(block->atoms + half, block->atoms + block->size, next->atoms);
+    next->size = block->size - half;
+    block->size = half;
+    for (unsigned i = 0; i < next->size; ++i)
+    {
+        next->atoms[i]->setMapHandle(next);
+    }
+    mBlocks.insert(mBlocks.begin() + b + 1, next);
+    mFirstKeys.insert(mFirstKeys.begin() + b + 1, next->keys[0]);
+}
+
+// move all atoms from the following block into this one
+void BlockedConcurrentAtomMap::mergeWithNext(unsigned b)
+{
+    ConcurrentAtomBlock *block = mBlocks[b];
+    ConcurrentAtomBlock *next = mBlocks[b + 1];
+    GAPS_ASSERT(block->size + next->size <= GAPS_ATOM_BLOCK_CAPACITY);
+    std::copy(next->keys, next->keys + next->size, block->keys + block->size);
+    std::copy(next->atoms, next->atoms + next->size, block->atoms + block->size);
+    for (unsigned i = 0; i < next->size; ++i)
+    {
+        next->atoms[i]->setMapHandle(block);
+    }
+    block->size += next->size;
+    next->size = 0;
+    mFirstKeys[b] = block->keys[0];
+    removeBlock(b + 1);
+}
+
+void BlockedConcurrentAtomMap::removeBlock(unsigned b)
+{
+    GAPS_ASSERT(mBlocks[b]->size == 0);
+    delete mBlocks[b];
+    mBlocks.erase(mBlocks.begin() + b);
+    mFirstKeys.erase(mFirstKeys.begin() + b);
+}
+
+#endif // GAPS_STD_MAP_ATOMIC_DOMAIN
@@ -0,0 +1,97 @@
+#ifndef __COGAPS_CONCURRENT_ATOM_MAP_H__
+#define __COGAPS_CONCURRENT_ATOM_MAP_H__
+
+#include <stdint.h>
+#include <vector>
+
+struct ConcurrentAtom;
+
+// The atomic domain keeps an ordered index of all atoms, keyed by position.
+// This index must be able to find the neighbors of a newly inserted atom,
+// answer exact membership queries, erase a known atom, and change the position
+// of an atom. Position changes never re-order the atoms and must be safe to
+// call concurrently from OpenMP threads for distinct atoms. Each atom stores a
+// handle given to it by the index so that erase and position changes don't
+// require a search.
+//
+// Two backends satisfy this contract, the backend is chosen at compile time.
+// By default atoms are indexed in sorted blocks of contiguous memory, defining
+// GAPS_STD_MAP_ATOMIC_DOMAIN switches back to a red-black tree (std::map).
+
+#ifdef GAPS_STD_MAP_ATOMIC_DOMAIN
+
+#include "../data_structures/MutableMap.h"
+
+class StdConcurrentAtomMap
+{
+public:
+    typedef MutableMap<uint64_t, ConcurrentAtom*>::iterator Handle;
+    StdConcurrentAtomMap();
+    ~StdConcurrentAtomMap();
+    void insert(ConcurrentAtom *atom, ConcurrentAtom **left, ConcurrentAtom **right);
+    void erase(ConcurrentAtom *atom);
+    void updatePos(ConcurrentAtom *atom, uint64_t newPos); // OpenMP thread safe
+    bool contains(uint64_t pos) const;
+    ConcurrentAtom* front() const;
+    uint64_t size() const;
+private:
+    StdConcurrentAtomMap(const StdConcurrentAtomMap&); // = delete (no c++11)
+    StdConcurrentAtomMap& operator=(const StdConcurrentAtomMap&); // = delete (no c++11)
+
+    MutableMap<uint64_t, ConcurrentAtom*> mMap;
+    uint64_t mSize;
+};
+
+typedef StdConcurrentAtomMap ConcurrentAtomMapType;
+
+#else
+
+// number of atoms stored in a single block, a block of keys spans 16 cache lines
+#define GAPS_ATOM_BLOCK_CAPACITY 128
+
+// keys and atoms are stored in separate arrays so that searching a block
+// only touches the keys
+struct ConcurrentAtomBlock
+{
+    ConcurrentAtomBlock();
+    uint64_t keys[GAPS_ATOM_BLOCK_CAPACITY];
+    ConcurrentAtom *atoms[GAPS_ATOM_BLOCK_CAPACITY];
+    unsigned size;
+};
+
+// Atoms are stored in a sorted list of fixed capacity blocks. A block is found
+// by binary search over the first key of every block, these keys are kept in
+// one contiguous vector. Position changes are made directly in the block of the
+// atom (the handle) without touching the first key vector, so this vector is
+// only used as a hint and the search always verifies it against the blocks.
+class BlockedConcurrentAtomMap
+{
+public:
+    typedef ConcurrentAtomBlock* Handle;
+    BlockedConcurrentAtomMap();
+    ~BlockedConcurrentAtomMap();
+    void insert(ConcurrentAtom *atom, ConcurrentAtom **left, ConcurrentAtom **right);
+    void erase(ConcurrentAtom *atom);
+    void updatePos(ConcurrentAtom *atom, uint64_t newPos); // OpenMP thread safe
+    bool contains(uint64_t pos) const;
+    ConcurrentAtom* front() const;
+    uint64_t size() const;
+private:
+    BlockedConcurrentAtomMap(const BlockedConcurrentAtomMap&); // = delete (no c++11)
+    BlockedConcurrentAtomMap& operator=(const BlockedConcurrentAtomMap&); // = delete (no c++11)
+
+    unsigned findBlock(uint64_t pos) const;
+    void splitBlock(unsigned b);
+    void mergeWithNext(unsigned b);
+    void removeBlock(unsigned b);
+
+    std::vector<ConcurrentAtomBlock*> mBlocks;
+    mutable std::vector<uint64_t> mFirstKeys; // refreshed whenever a search passes through
+    uint64_t mSize;
+};
+
+typedef BlockedConcurrentAtomMap ConcurrentAtomMapType;
+
+#endif // GAPS_STD_MAP_ATOMIC_DOMAIN
+
+#endif // __COGAPS_CONCURRENT_ATOM_MAP_H__
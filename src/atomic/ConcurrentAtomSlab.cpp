@@ -0,0 +1,72 @@
+#include "ConcurrentAtomSlab.h"
+#include "ConcurrentAtom.h"
+#include "../utils/GapsAssert.h"
+
+#include <new>
+
+ConcurrentAtomSlab::ConcurrentAtomSlab() : mSlabUsed(GAPS_ATOM_SLAB_CAPACITY) {}
+
+// atoms are trivially destructible, only the raw memory needs to be freed
+ConcurrentAtomSlab::~ConcurrentAtomSlab()
+{
+    for (unsigned i = 0; i < mSlabs.size(); ++i)
+    {
+        ::operator delete(mSlabs[i]);
+    }
+}
+
+ConcurrentAtom* ConcurrentAtomSlab::allocate(uint64_t pos, float mass)
+{
+    void *mem = NULL;
+    if (!mFreeList.empty())
+    {
+        mem = mFreeList.back();
+        mFreeList.pop_back();
+    }
+    else
+    {
+        if (mSlabUsed == GAPS_ATOM_SLAB_CAPACITY)
+        {
+            addSlab();
+        }
+        mem = mSlabs.back() + mSlabUsed++;
+    }
+    return new (mem) ConcurrentAtom(pos, mass);
+}
+
+void ConcurrentAtomSlab::release(ConcurrentAtom *atom)
+{
+    GAPS_ASSERT(atom != NULL);
+    mFreeList.push_back(atom);
+}
+
+// make sure n atoms can be allocated without creating another slab
+void ConcurrentAtomSlab::reserve(uint64_t n)
+{
+    while (capacity() - size() < n)
+    {
+        addSlab();
+    }
+}
+
+uint64_t ConcurrentAtomSlab::size() const
+{
+    return capacity() - mFreeList.size() - (GAPS_ATOM_SLAB_CAPACITY - mSlabUsed);
+}
+
+uint64_t ConcurrentAtomSlab::capacity() const
+{
+    return static_cast<uint64_t>(mSlabs.size()) * GAPS_ATOM_SLAB_CAPACITY;
+}
+
+// any unused atoms left in the current slab are moved to the free list
+void ConcurrentAtomSlab::addSlab()
+{
+    while (mSlabUsed < GAPS_ATOM_SLAB_CAPACITY)
+    {
+        mFreeList.push_back(mSlabs.back() + mSlabUsed++);
+    }
+    mSlabs.push_back(static_cast<ConcurrentAtom*>(::operator new(
+        GAPS_ATOM_SLAB_CAPACITY * sizeof(ConcurrentAtom))));
+    mSlabUsed = 0;
+}
@@ -0,0 +1,38 @@
+#ifndef __COGAPS_CONCURRENT_ATOM_SLAB_H__
+#define __COGAPS_CONCURRENT_ATOM_SLAB_H__
+
+#include <stdint.h>
+#include <vector>
+
+struct ConcurrentAtom;
+
+// number of atoms allocated together in one contiguous slab
+#define GAPS_ATOM_SLAB_CAPACITY 1024
+
+// Allocates atoms from fixed size slabs of contiguous memory. Slabs are never
+// moved or freed while the allocator is alive, so pointers to atoms remain
+// valid. Released atoms are put on a free list and the most recently released
+// atom is the first to be reused, since its memory is most likely still cached.
+// None of these functions are thread safe.
+class ConcurrentAtomSlab
+{
+public:
+    ConcurrentAtomSlab();
+    ~ConcurrentAtomSlab();
+    ConcurrentAtom* allocate(uint64_t pos, float mass);
+    void release(ConcurrentAtom *atom);
+    void reserve(uint64_t n);
+    uint64_t size() const;
+    uint64_t capacity() const;
+private:
+    ConcurrentAtomSlab(const ConcurrentAtomSlab &other); // = delete (no c++11)
+    ConcurrentAtomSlab& operator=(const ConcurrentAtomSlab &other); // = delete (no c++11)
+
+    void addSlab();
+
+    std::vector<ConcurrentAtom*> mSlabs;
+    std::vector<ConcurrentAtom*> mFreeList;
+    unsigned mSlabUsed; // number of atoms ever handed out from the last slab
+};
+
+#endif // __COGAPS_CONCURRENT_ATOM_SLAB_H__
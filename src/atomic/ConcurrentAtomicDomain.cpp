@@ -4,6 +4,7 @@
 #include "../utils/GapsAssert.h"
 
 #include <algorithm>
+#include <cstddef>
 #include <limits>
 
 static bool compareAtoms(ConcurrentAtom *a1, ConcurrentAtom *a2)
@@ -12,6 +13,7 @@ static bool compareAtoms(ConcurrentAtom *a1, ConcurrentAtom *a2)
 }
 
 ConcurrentAtomicDomain::ConcurrentAtomicDomain(uint64_t nBins)
+    : mEraseCacheSize(0), mMoveCacheSize(0), mCacheOverflow(false)
 {
     uint64_t binLength = std::numeric_limits<uint64_t>::max() / nBins;
     mDomainLength = binLength * nBins;
@@ -20,13 +22,13 @@ ConcurrentAtomicDomain::ConcurrentAtomicDomain(uint64_t nBins)
 ConcurrentAtom* ConcurrentAtomicDomain::front()
 {
     GAPS_ASSERT(size() > 0);
-    return (*mAtomMap.begin()).second;
+    return mAtomMap.front();
 }
 
 const ConcurrentAtom* ConcurrentAtomicDomain::front() const
 {
     GAPS_ASSERT(size() > 0);
-    return (*mAtomMap.begin()).second;
+    return mAtomMap.front();
 }
 
 ConcurrentAtom* ConcurrentAtomicDomain::randomAtom(GapsRng *rng)
@@ -46,7 +48,7 @@ ConcurrentAtomNeighborhood ConcurrentAtomicDomain::randomAtomWithNeighbors(GapsR
 uint64_t ConcurrentAtomicDomain::randomFreePosition(GapsRng *rng) const
 {
     uint64_t pos = rng->uniform64(1, mDomainLength);
-    while (mAtomMap.count(pos))
+    while (mAtomMap.contains(pos))
     {
         pos = rng->uniform64(1, mDomainLength);
     }
@@ -58,48 +60,128 @@ uint64_t ConcurrentAtomicDomain::size() const
     return mAtoms.size();
 }
 
-// safe to call concurrently from OpenMP threads
+// not thread safe, must be called before cacheErase is used with an upper
+// bound on the number of atoms that will be erased before the next flush -
+// the sampler reserves one slot per proposal, each proposal erases at most
+// one atom
+void ConcurrentAtomicDomain::reserveEraseCache(unsigned n)
+{
+    GAPS_ASSERT(mEraseCacheSize == 0);
+    if (mEraseCache.size() < n)
+    {
+        mEraseCache.resize(n, NULL);
+    }
+}
+
+// safe to call concurrently from OpenMP threads, each thread claims a unique
+// slot in the cache with an atomic increment so no lock is needed - a slot
+// past the reserved size is never written, the overflow is recorded when the
+// cache is flushed
 void ConcurrentAtomicDomain::cacheErase(ConcurrentAtom *atom)
 {
-    #pragma omp critical(AtomicInsertOrErase)
+    unsigned slot = 0;
+    #pragma omp atomic capture
+    slot = mEraseCacheSize++;
+
+    GAPS_ASSERT(slot < mEraseCache.size());
+    if (slot < mEraseCache.size())
     {
-        mEraseCache.push_back(atom);
+        mEraseCache[slot] = atom;
     }
 }
 
-// not thread safe
+// not thread safe, memory of erased atoms is recycled by the next insert
 void ConcurrentAtomicDomain::flushEraseCache()
 {
-    std::sort(mEraseCache.begin(), mEraseCache.end(), compareAtoms);
-    for (unsigned i = 0; i < mEraseCache.size(); ++i)
+    if (mEraseCacheSize > mEraseCache.size())
+    {
+        mCacheOverflow = true;
+        mEraseCacheSize = mEraseCache.size();
+    }
+
+    // atoms are cached in a non-deterministic order when running with
+    // multiple threads, sorting makes the order of erasing consistent
+    std::sort(mEraseCache.begin(), mEraseCache.begin() + mEraseCacheSize, compareAtoms);
+    for (unsigned i = 0; i < mEraseCacheSize; ++i)
     {
         erase(mEraseCache[i]);
     }
-    mEraseCache.clear();
+    mEraseCacheSize = 0;
+}
+
+// not thread safe, must be called before cacheMove is used with an upper
+// bound on the number of atoms that will be moved before the next flush -
+// the sampler reserves one slot per proposal, each proposal moves at most
+// one atom
+void ConcurrentAtomicDomain::reserveMoveCache(unsigned n)
+{
+    GAPS_ASSERT(mMoveCacheSize == 0);
+    if (mMoveCache.size() < n)
+    {
+        mMoveCache.resize(n, std::pair<ConcurrentAtom*, uint64_t>(NULL, 0));
+    }
+}
+
+// safe to call concurrently from OpenMP threads, the atom keeps its current
+// position until the cache is flushed
+void ConcurrentAtomicDomain::cacheMove(ConcurrentAtom *atom, uint64_t newPos)
+{
+    unsigned slot = 0;
+    #pragma omp atomic capture
+    slot = mMoveCacheSize++;
+
+    GAPS_ASSERT(slot < mMoveCache.size());
+    if (slot < mMoveCache.size())
+    {
+        mMoveCache[slot] = std::pair<ConcurrentAtom*, uint64_t>(atom, newPos);
+    }
+}
+
+// not thread safe, cached moves never involve neighboring atoms so the order
+// they are applied in doesn't matter
+void ConcurrentAtomicDomain::flushMoveCache()
+{
+    if (mMoveCacheSize > mMoveCache.size())
+    {
+        mCacheOverflow = true;
+        mMoveCacheSize = mMoveCache.size();
+    }
+
+    for (unsigned i = 0; i < mMoveCacheSize; ++i)
+    {
+        move(mMoveCache[i].first, mMoveCache[i].second);
+    }
+    mMoveCacheSize = 0;
+}
+
+// true if an erase or move was ever dropped because the cache was full, the
+// sampler is then in an invalid state
+bool ConcurrentAtomicDomain::cacheOverflowed() const
+{
+    return mCacheOverflow;
 }
 
 // not thread safe
 ConcurrentAtom* ConcurrentAtomicDomain::insert(uint64_t pos, float mass)
 {
-    // insert atom into vector and map, record the iterator and index in each
-    ConcurrentAtom *atom = new ConcurrentAtom(pos, mass);
-    atom->setIterator(mAtomMap.insert(std::pair<uint64_t, ConcurrentAtom*>(pos, atom)).first);
+    // insert atom into vector and map, record the index in the vector
+    ConcurrentAtom *atom = mAtomSlab.allocate(pos, mass);
+    ConcurrentAtom *left = NULL;
+    ConcurrentAtom *right = NULL;
+    mAtomMap.insert(atom, &left, &right);
     atom->setIndex(mAtoms.size());
     mAtoms.push_back(atom);
 
     // connect with right and left neighbors
-    ConcurrentAtomMapType::iterator itRight(atom->iterator());
-    if (++itRight != mAtomMap.end())
+    if (right != NULL)
     {
-        atom->setRight((*itRight).second);
-        (*itRight).second->setLeft(atom);
+        atom->setRight(right);
+        right->setLeft(atom);
     }
-    ConcurrentAtomMapType::iterator itLeft(atom->iterator());
-    if (itLeft != mAtomMap.begin())
+    if (left != NULL)
     {
-        --itLeft;
-        atom->setLeft((*itLeft).second);
-        (*itLeft).second->setRight(atom);
+        atom->setLeft(left);
+        left->setRight(atom);
     }
     return atom;
 }
@@ -107,7 +189,7 @@ ConcurrentAtom* ConcurrentAtomicDomain::insert(uint64_t pos, float mass)
 // not thread safe
 void ConcurrentAtomicDomain::erase(ConcurrentAtom *atom)
 {
-    mAtomMap.erase(atom->iterator());
+    mAtomMap.erase(atom);
     mAtoms[atom->index()] = mAtoms.back();
     mAtoms[atom->index()]->setIndex(atom->index());
     mAtoms.pop_back();
@@ -119,7 +201,7 @@ void ConcurrentAtomicDomain::erase(ConcurrentAtom *atom)
     {
         atom->right()->setLeft(atom->left());
     }
-    delete atom;
+    mAtomSlab.release(atom);
 }
 
 // safe to call concurrently from OpenMP threads
@@ -127,8 +209,8 @@ void ConcurrentAtomicDomain::move(ConcurrentAtom *atom, uint64_t newPos)
 {
     GAPS_ASSERT(newPos > (atom->hasLeft() ? atom->left()->pos() : 0));
     GAPS_ASSERT(newPos < (atom->hasRight() ? atom->right()->pos() : mDomainLength));
+    mAtomMap.updatePos(atom, newPos);
     atom->updatePos(newPos);
-    mAtomMap.updateKey(atom->iterator(), newPos);
 }
 
 Archive& operator<<(Archive &ar, const ConcurrentAtomicDomain &domain)
@@ -146,6 +228,7 @@ Archive& operator>>(Archive &ar, ConcurrentAtomicDomain &domain)
     ConcurrentAtom temp(0, 0.f);
     uint64_t size = 0;
     ar >> domain.mDomainLength >> size;
+    domain.mAtomSlab.reserve(size);
     for (unsigned i = 0; i < size; ++i)
     {
         ar >> temp;
@@ -2,7 +2,9 @@
 #define __COGAPS_CONCURRENT_ATOMIC_DOMAIN_H__
 
 #include "ConcurrentAtom.h"
+#include "ConcurrentAtomSlab.h"
 
+#include <utility>
 #include <vector>
 
 template <class StoragePolicy>
@@ -23,9 +25,14 @@ public:
     ConcurrentAtomNeighborhood randomAtomWithNeighbors(GapsRng *rng);
     uint64_t randomFreePosition(GapsRng *rng) const;
     uint64_t size() const;
+    void reserveEraseCache(unsigned n);
     void cacheErase(ConcurrentAtom *atom); // OpenMP thread safe
     void move(ConcurrentAtom *atom, uint64_t newPos); // OpenMP thread safe
     void flushEraseCache();
+    void reserveMoveCache(unsigned n);
+    void cacheMove(ConcurrentAtom *atom, uint64_t newPos); // OpenMP thread safe
+    void flushMoveCache();
+    bool cacheOverflowed() const;
     friend Archive& operator<<(Archive &ar, const ConcurrentAtomicDomain &domain);
     friend Archive& operator>>(Archive &ar, ConcurrentAtomicDomain &domain);
 #ifdef GAPS_DEBUG
@@ -42,9 +49,14 @@ private:
     ConcurrentAtom* insert(uint64_t pos, float mass);
     void erase(ConcurrentAtom *atom);
 
+    ConcurrentAtomSlab mAtomSlab; // owns the memory of all atoms
     ConcurrentAtomMapType mAtomMap; // sorted, used when inserting atoms to find neighbors
     std::vector<ConcurrentAtom*> mAtoms; // unsorted, used for random selection of atoms
-    std::vector<ConcurrentAtom*> mEraseCache;
+    std::vector<ConcurrentAtom*> mEraseCache; // preallocated, filled up to mEraseCacheSize
+    unsigned mEraseCacheSize;
+    std::vector< std::pair<ConcurrentAtom*, uint64_t> > mMoveCache; // preallocated, filled up to mMoveCacheSize
+    unsigned mMoveCacheSize;
+    bool mCacheOverflow; // set if more atoms were cached than reserved for
     uint64_t mDomainLength; // size of atomic domain to ensure all bins are equal length
 };
 
@@ -9,10 +9,14 @@
 
 //////////////////////////////// AtomicProposal ////////////////////////////////
 
-AtomicProposal::AtomicProposal(char t, GapsRandomState *randState)
-    : rng(randState), pos(0), atom1(NULL), atom2(NULL), r1(0), c1(0), r2(0),
+AtomicProposal::AtomicProposal(char t, const GapsRng &r)
+    : rng(r), pos(0), atom1(NULL), atom2(NULL), r1(0), c1(0), r2(0),
     c2(0), type(t)
 {}
+
+DeferredProposal::DeferredProposal(float t_u1, float t_u2, const GapsRng &t_rng)
+    : rng(t_rng), u1(t_u1), u2(t_u2)
+{}
     
 //////////////////////////////// ProposalQueue /////////////////////////////////
 
@@ -20,10 +24,15 @@ ProposalQueue::ProposalQueue(uint64_t nElements, uint64_t nPatterns,
 GapsRandomState *randState)
     :
 mUsedMatrixIndices(nElements / nPatterns),
+mEvaluatingMatrixIndices(nElements / nPatterns),
 mRandState(randState),
 mRng(randState),
 mMinAtoms(0),
 mMaxAtoms(0),
+mEvaluatingMinAtoms(0),
+mEvaluatingMaxAtoms(0),
+mHandOffMinAtoms(0),
+mHandOffMaxAtoms(0),
 mBinLength(std::numeric_limits<uint64_t>::max() / nElements),
 mNumCols(nPatterns),
 mAlpha(0.0),
@@ -32,8 +41,15 @@ mNumBins(static_cast<double>(nElements)),
 mU1(0.f),
 mU2(0.f),
 mNumProcessed(0),
-mUseCachedRng(false)
-{}
+mUseCachedRng(false),
+mSpeculative(false),
+mEvaluating(false)
+{
+    for (unsigned i = 0; i < N_PROPOSAL_CONFLICTS; ++i)
+    {
+        mConflicts[i] = 0;
+    }
+}
 
 void ProposalQueue::setAlpha(float alpha)
 {
@@ -45,28 +61,54 @@ void ProposalQueue::setLambda(float lambda)
     mLambda = lambda;
 }
 
+void ProposalQueue::setSpeculative(bool speculative)
+{
+    mSpeculative = speculative;
+}
+
 unsigned ProposalQueue::nProcessed() const
 {
     return mNumProcessed;
 }
 
+// number of times a proposal was stopped by each type of conflict
+std::vector<uint64_t> ProposalQueue::conflictHistogram() const
+{
+    return std::vector<uint64_t>(mConflicts, mConflicts + N_PROPOSAL_CONFLICTS);
+}
+
 void ProposalQueue::populate(ConcurrentAtomicDomain &domain, unsigned limit)
 {
     GAPS_ASSERT(mQueue.empty());
     GAPS_ASSERT(mUsedAtoms.isEmpty());
     GAPS_ASSERT(mUsedMatrixIndices.isEmpty());
     GAPS_ASSERT(mProposedMoves.isEmpty());
-    GAPS_ASSERT(mMinAtoms == mMaxAtoms);
+    GAPS_ASSERT(mEvaluating || mMinAtoms == mMaxAtoms);
     GAPS_ASSERT_MSG(mMaxAtoms == domain.size(), mMaxAtoms << " != " << domain.size());
 
-    bool success = true;
     mNumProcessed = 0;
+    if (mSpeculative)
+    {
+        populateSpeculative(domain, limit);
+        return;
+    }
+
+    // stop at the first conflict, the same proposal is attempted first when
+    // the next queue is populated - this would keep hitting the same conflict
+    // while another queue is evaluated, so that requires speculative mode
+    GAPS_ASSERT(!mEvaluating);
+    bool success = true;
     while (mNumProcessed < limit && success)
     {
-        if (!makeProposal(domain))
+        mU1 = mUseCachedRng ? mU1 : mRng.uniform();
+        mU2 = mUseCachedRng ? mU2 : mRng.uniform();
+        mUseCachedRng = false;
+        GapsRng rng(mRandState);
+        if (!makeProposal(domain, mU1, mU2, rng))
         {
             success = false;
             mUseCachedRng = true;
+            mRandState->rollBackOnce(); // ensure same proposal next time
         }
         else
         {
@@ -75,49 +117,116 @@ void ProposalQueue::populate(ConcurrentAtomicDomain &domain, unsigned limit)
     }
 }
 
-void ProposalQueue::clear()
+// Conflicting proposals are deferred to the next queue instead of ending this
+// one. Deferred proposals keep their random numbers, so the sequence of
+// proposals only depends on the seed. Every deferred proposal counts towards
+// the limit, so none are left over once the limit is processed. The first
+// proposal of a new queue never conflicts unless another queue is being
+// evaluated, so without one at least one proposal is processed.
+void ProposalQueue::populateSpeculative(ConcurrentAtomicDomain &domain, unsigned limit)
 {
-    GAPS_ASSERT(mMinAtoms == mMaxAtoms);
-    mQueue.clear();
-    mUsedMatrixIndices.clear();
-    mUsedAtoms.clear();
-    mProposedMoves.clear();
+    GAPS_ASSERT(mDeferredProposals.size() <= limit);
+    std::vector<DeferredProposal> deferred;
+    deferred.swap(mDeferredProposals);
+    for (unsigned i = 0; i < deferred.size(); ++i)
+    {
+        if (makeProposal(domain, deferred[i].u1, deferred[i].u2, deferred[i].rng))
+        {
+            ++mNumProcessed;
+        }
+        else
+        {
+            mDeferredProposals.push_back(deferred[i]);
+        }
+    }
+    GAPS_ASSERT(mEvaluating || deferred.empty() || mNumProcessed > 0);
+
+    while (mNumProcessed + mDeferredProposals.size() < limit
+    && mDeferredProposals.size() < GAPS_MAX_DEFERRED_PROPOSALS)
+    {
+        float u1 = mRng.uniform();
+        float u2 = mRng.uniform();
+        GapsRng rng(mRandState);
+        if (makeProposal(domain, u1, u2, rng))
+        {
+            ++mNumProcessed;
+        }
+        else
+        {
+            mDeferredProposals.push_back(DeferredProposal(u1, u2, rng));
+        }
+    }
+}
+
+// The populated queue is handed off to the sampler, size and operator[] now
+// refer to it. Its rows and atoms stay in use until endEvaluation, so the
+// next queue can be populated against this frozen snapshot while the
+// proposals are evaluated. The atom count bounds of the next queue start from
+// the bounds of this one and are not touched by the evaluation.
+void ProposalQueue::beginEvaluation()
+{
+    GAPS_ASSERT(!mEvaluating);
+    GAPS_ASSERT(mEvaluatingQueue.empty());
+    mQueue.swap(mEvaluatingQueue);
+    mUsedMatrixIndices.swap(mEvaluatingMatrixIndices);
+    mUsedAtoms.swap(mEvaluatingAtoms);
+    mProposedMoves.swap(mEvaluatingMoves);
+    mEvaluatingMinAtoms = mMinAtoms;
+    mEvaluatingMaxAtoms = mMaxAtoms;
+    mHandOffMinAtoms = mMinAtoms;
+    mHandOffMaxAtoms = mMaxAtoms;
+    mEvaluating = true;
+}
+
+// once every proposal has been evaluated the number of atoms is known, shift
+// the bounds of any queue populated in the meantime by the same amount
+void ProposalQueue::endEvaluation()
+{
+    GAPS_ASSERT(mEvaluating);
+    GAPS_ASSERT(mEvaluatingMinAtoms == mEvaluatingMaxAtoms);
+    mMinAtoms = mMinAtoms + mEvaluatingMinAtoms - mHandOffMinAtoms;
+    mMaxAtoms = mMaxAtoms - (mHandOffMaxAtoms - mEvaluatingMaxAtoms);
+    mEvaluatingQueue.clear();
+    mEvaluatingMatrixIndices.clear();
+    mEvaluatingAtoms.clear();
+    mEvaluatingMoves.clear();
+    mEvaluating = false;
 }
 
 unsigned ProposalQueue::size() const
 {
-    return mQueue.size();
+    return mEvaluatingQueue.size();
 }
 
 AtomicProposal& ProposalQueue::operator[](int n)
 {
-    GAPS_ASSERT(mQueue.size() > 0);
-    GAPS_ASSERT(static_cast<unsigned>(n) < mQueue.size());
-    return mQueue[n];
+    GAPS_ASSERT(mEvaluatingQueue.size() > 0);
+    GAPS_ASSERT(static_cast<unsigned>(n) < mEvaluatingQueue.size());
+    return mEvaluatingQueue[n];
 }
 
 void ProposalQueue::acceptDeath()
 {
     #pragma omp atomic
-    --mMaxAtoms;
+    --mEvaluatingMaxAtoms;
 }
 
 void ProposalQueue::rejectDeath()
 {
     #pragma omp atomic
-    ++mMinAtoms;
+    ++mEvaluatingMinAtoms;
 }
 
 void ProposalQueue::acceptBirth()
 {
     #pragma omp atomic
-    ++mMinAtoms;
+    ++mEvaluatingMinAtoms;
 }
 
 void ProposalQueue::rejectBirth()
 {
     #pragma omp atomic
-    --mMaxAtoms;
+    --mEvaluatingMaxAtoms;
 }
 
 float ProposalQueue::deathProb(double nAtoms) const
@@ -126,56 +235,77 @@ float ProposalQueue::deathProb(double nAtoms) const
     return numer / (numer + mAlpha * mNumBins * (mDomainLength - nAtoms));
 }
 
-bool ProposalQueue::makeProposal(ConcurrentAtomicDomain &domain)
+bool ProposalQueue::conflict(ProposalConflict reason)
 {
-    mU1 = mUseCachedRng ? mU1 : mRng.uniform();
-    mU2 = mUseCachedRng ? mU2: mRng.uniform();
-    mUseCachedRng = false;
+    ++mConflicts[reason];
+    return false;
+}
 
+// the next three checks cover both the queue being populated and the queue
+// being evaluated, if there is one
+
+bool ProposalQueue::rowInUse(unsigned row)
+{
+    return mUsedMatrixIndices.contains(row) || mEvaluatingMatrixIndices.contains(row);
+}
+
+bool ProposalQueue::atomInUse(uint64_t pos)
+{
+    return mUsedAtoms.contains(pos) || mEvaluatingAtoms.contains(pos);
+}
+
+bool ProposalQueue::insideProposedMove(uint64_t pos)
+{
+    return mProposedMoves.overlap(pos) || mEvaluatingMoves.overlap(pos);
+}
+
+// the proposal is fully determined by u1, u2 and rng, if it conflicts with the
+// current queue nothing is changed and false is returned
+bool ProposalQueue::makeProposal(ConcurrentAtomicDomain &domain, float u1,
+float u2, const GapsRng &rng)
+{
     if (mMinAtoms < 2 && mMaxAtoms >= 2)
     {
-        return false; // special indeterminate case
+        return conflict(CONFLICT_BIRTH_DEATH); // special indeterminate case
     }
 
     if (mMaxAtoms < 2)
     {
-        return birth(domain); // always birth when 0 or 1 atoms exist
+        return birth(domain, rng); // always birth when 0 or 1 atoms exist
     }
 
     float lowerBound = deathProb(static_cast<double>(mMinAtoms));
     float upperBound = deathProb(static_cast<double>(mMaxAtoms));
-    if (mU1 < 0.5f)
+    if (u1 < 0.5f)
     {
-        if (mU2 < lowerBound)
+        if (u2 < lowerBound)
         {
-            return death(domain);
+            return death(domain, rng);
         }
-        if (mU2 >= upperBound)
+        if (u2 >= upperBound)
         {
-            return birth(domain);
+            return birth(domain, rng);
         }
-        return false; // can't determine B/D since range is too wide
+        return conflict(CONFLICT_BIRTH_DEATH); // can't determine B/D since range is too wide
     }
-    return (mU1 < 0.75f) ? move(domain) : exchange(domain);
+    return (u1 < 0.75f) ? move(domain, rng) : exchange(domain, rng);
 }
 
-bool ProposalQueue::birth(ConcurrentAtomicDomain &domain)
+bool ProposalQueue::birth(ConcurrentAtomicDomain &domain, const GapsRng &rng)
 {
-    AtomicProposal prop('B', mRandState);
+    AtomicProposal prop('B', rng);
     uint64_t pos = domain.randomFreePosition(&(prop.rng));
 
-    if (mProposedMoves.overlap(pos))
+    if (insideProposedMove(pos))
     {
-        mRandState->rollBackOnce(); // ensure same proposal next time
-        return false; // this birth would break assumption moves doesn't re-order domain
+        return conflict(CONFLICT_PROPOSED_MOVE); // this birth would break assumption moves doesn't re-order domain
     }
 
     prop.r1 = (pos / mBinLength) / mNumCols;
     prop.c1 = (pos / mBinLength) % mNumCols;
-    if (mUsedMatrixIndices.contains(prop.r1))
+    if (rowInUse(prop.r1))
     {
-        mRandState->rollBackOnce(); // ensure same proposal next time
-        return false; // matrix conflict - can't compute gibbs mass
+        return conflict(CONFLICT_MATRIX); // matrix conflict - can't compute gibbs mass
     }
     prop.atom1 = domain.insert(pos, 0.f);
 
@@ -186,17 +316,16 @@ bool ProposalQueue::birth(ConcurrentAtomicDomain &domain)
     return true;
 }
 
-bool ProposalQueue::death(ConcurrentAtomicDomain &domain)
+bool ProposalQueue::death(ConcurrentAtomicDomain &domain, const GapsRng &rng)
 {
-    AtomicProposal prop('D', mRandState);
+    AtomicProposal prop('D', rng);
     prop.atom1 = domain.randomAtom(&(prop.rng));
     prop.r1 = (prop.atom1->pos() / mBinLength) / mNumCols;
     prop.c1 = (prop.atom1->pos() / mBinLength) % mNumCols;
 
-    if (mUsedMatrixIndices.contains(prop.r1))
+    if (rowInUse(prop.r1))
     {
-        mRandState->rollBackOnce(); // ensure same proposal next time
-        return false; // matrix conflict - can't compute gibbs mass or deltaLL
+        return conflict(CONFLICT_MATRIX); // matrix conflict - can't compute gibbs mass or deltaLL
     }
 
     mUsedMatrixIndices.insert(prop.r1);
@@ -206,19 +335,18 @@ bool ProposalQueue::death(ConcurrentAtomicDomain &domain)
     return true;
 }
 
-bool ProposalQueue::move(ConcurrentAtomicDomain &domain)
+bool ProposalQueue::move(ConcurrentAtomicDomain &domain, const GapsRng &rng)
 {
-    AtomicProposal prop('M', mRandState);
+    AtomicProposal prop('M', rng);
     ConcurrentAtomNeighborhood hood = domain.randomAtomWithNeighbors(&(prop.rng));
     prop.atom1 = hood.center;
 
     uint64_t lbound = hood.hasLeft() ? hood.left->pos() : 0;
     uint64_t rbound = hood.hasRight() ? hood.right->pos() : static_cast<uint64_t>(mDomainLength);
 
-    if (mUsedAtoms.contains(lbound) || mUsedAtoms.contains(rbound))
+    if (atomInUse(lbound) || atomInUse(rbound))
     {
-        mRandState->rollBackOnce(); // ensure same proposal next time
-        return false; // atomic conflict - don't know neighbors
+        return conflict(CONFLICT_ATOM); // atomic conflict - don't know neighbors
     }
 
     prop.pos = prop.rng.uniform64(lbound + 1, rbound - 1);
@@ -227,10 +355,9 @@ bool ProposalQueue::move(ConcurrentAtomicDomain &domain)
     prop.r2 = (prop.pos / mBinLength) / mNumCols;
     prop.c2 = (prop.pos / mBinLength) % mNumCols;
 
-    if (mUsedMatrixIndices.contains(prop.r1) || mUsedMatrixIndices.contains(prop.r2))
+    if (rowInUse(prop.r1) || rowInUse(prop.r2))
     {
-        mRandState->rollBackOnce(); // ensure same proposal next time
-        return false; // matrix conflict - can't compute deltaLL
+        return conflict(CONFLICT_MATRIX); // matrix conflict - can't compute deltaLL
     }
 
     if (prop.r1 == prop.r2 && prop.c1 == prop.c2)
@@ -247,9 +374,9 @@ bool ProposalQueue::move(ConcurrentAtomicDomain &domain)
     return true;
 }
 
-bool ProposalQueue::exchange(ConcurrentAtomicDomain &domain)
+bool ProposalQueue::exchange(ConcurrentAtomicDomain &domain, const GapsRng &rng)
 {
-    AtomicProposal prop('E', mRandState);
+    AtomicProposal prop('E', rng);
     ConcurrentAtomNeighborhood hood = domain.randomAtomWithNeighbors(&(prop.rng));
     prop.atom1 = hood.center;
     prop.atom2 = hood.hasRight() ? hood.right : domain.front();
@@ -258,10 +385,9 @@ bool ProposalQueue::exchange(ConcurrentAtomicDomain &domain)
     prop.r2 = (prop.atom2->pos() / mBinLength) / mNumCols;
     prop.c2 = (prop.atom2->pos() / mBinLength) % mNumCols;
 
-    if (mUsedMatrixIndices.contains(prop.r1) || mUsedMatrixIndices.contains(prop.r2))
+    if (rowInUse(prop.r1) || rowInUse(prop.r2))
     {
-        mRandState->rollBackOnce(); // ensure same proposal next time
-        return false; // matrix conflict - can't compute deltaLL or gibbs mass
+        return conflict(CONFLICT_MATRIX); // matrix conflict - can't compute deltaLL or gibbs mass
     }
 
     if (prop.r1 == prop.r2 && prop.c1 == prop.c2)
@@ -282,8 +408,11 @@ bool ProposalQueue::exchange(ConcurrentAtomicDomain &domain)
     return true;
 }
 
+// checkpoints are only created between calls to update, when all deferred
+// proposals have been processed
 Archive& operator<<(Archive &ar, const ProposalQueue &q)
 {
+    GAPS_ASSERT(q.mDeferredProposals.empty());
     ar << q.mRng << q.mMinAtoms << q.mMaxAtoms << q.mBinLength << q.mNumCols
         << q.mAlpha << q.mDomainLength << q.mNumBins << q.mLambda
         << q.mUseCachedRng << q.mU1 << q.mU2;
@@ -12,9 +12,24 @@ struct ConcurrentAtom;
 class Archive;
 class ConcurrentAtomicDomain;
 
+// reasons a proposal can not be added to the current queue
+enum ProposalConflict
+{
+    CONFLICT_BIRTH_DEATH=0, // birth/death can't be determined from atom bounds
+    CONFLICT_MATRIX=1, // matrix row is already used by another proposal
+    CONFLICT_ATOM=2, // neighbor of atom is already used by another proposal
+    CONFLICT_PROPOSED_MOVE=3, // birth would land inside a proposed move
+    N_PROPOSAL_CONFLICTS=4
+};
+
+// maximum number of conflicting proposals deferred to the next queue when
+// running in speculative mode, this is fixed so that the queue is the same
+// regardless of the number of threads
+#define GAPS_MAX_DEFERRED_PROPOSALS 32
+
 struct AtomicProposal
 {
-    AtomicProposal(char t, GapsRandomState *randState);
+    AtomicProposal(char t, const GapsRng &r);
 
     mutable GapsRng rng; // used for consistency no matter number of threads 
     uint64_t pos; // used for move
@@ -27,14 +42,26 @@ struct AtomicProposal
     char type; // birth (B), death (D), move (M), exchange (E)
 };
 
+// the random numbers needed to exactly recreate a proposal
+struct DeferredProposal
+{
+    DeferredProposal(float t_u1, float t_u2, const GapsRng &t_rng);
+
+    GapsRng rng;
+    float u1;
+    float u2;
+};
+
 class ProposalQueue
 {
 public:
     ProposalQueue(uint64_t nElements, uint64_t nPatterns, GapsRandomState *randState);
     void setAlpha(float alpha);
     void setLambda(float lambda);
+    void setSpeculative(bool speculative);
     void populate(ConcurrentAtomicDomain &domain, unsigned limit);
-    void clear();
+    void beginEvaluation();
+    void endEvaluation();
     unsigned size() const;
     AtomicProposal& operator[](int n);
     void acceptDeath();
@@ -42,24 +69,44 @@ public:
     void acceptBirth();
     void rejectBirth();
     unsigned nProcessed() const;
+    std::vector<uint64_t> conflictHistogram() const;
     friend Archive& operator<<(Archive &ar, const ProposalQueue &queue);
     friend Archive& operator>>(Archive &ar, ProposalQueue &queue);
 private:
     float deathProb(double nAtoms) const;
-    bool makeProposal(ConcurrentAtomicDomain &domain);
-    bool birth(ConcurrentAtomicDomain &domain);
-    bool death(ConcurrentAtomicDomain &domain);
-    bool move(ConcurrentAtomicDomain &domain);
-    bool exchange(ConcurrentAtomicDomain &domain);
+    void populateSpeculative(ConcurrentAtomicDomain &domain, unsigned limit);
+    bool makeProposal(ConcurrentAtomicDomain &domain, float u1, float u2, const GapsRng &rng);
+    bool birth(ConcurrentAtomicDomain &domain, const GapsRng &rng);
+    bool death(ConcurrentAtomicDomain &domain, const GapsRng &rng);
+    bool move(ConcurrentAtomicDomain &domain, const GapsRng &rng);
+    bool exchange(ConcurrentAtomicDomain &domain, const GapsRng &rng);
+    bool conflict(ProposalConflict reason);
+    bool rowInUse(unsigned row);
+    bool atomInUse(uint64_t pos);
+    bool insideProposedMove(uint64_t pos);
 
+    // The queue is populated in mQueue and then handed off to the sampler,
+    // which evaluates the proposals in mEvaluatingQueue. The next queue can
+    // be populated while the last one is evaluated, as long as it doesn't
+    // conflict with either of them.
     std::vector<AtomicProposal> mQueue; // not really a queue for now
+    std::vector<AtomicProposal> mEvaluatingQueue;
+    std::vector<DeferredProposal> mDeferredProposals; // retried first in next queue
+    uint64_t mConflicts[N_PROPOSAL_CONFLICTS];
     FixedHashSetU32 mUsedMatrixIndices;
     SmallHashSetU64 mUsedAtoms;
     SmallPairedHashSetU64 mProposedMoves;
+    FixedHashSetU32 mEvaluatingMatrixIndices;
+    SmallHashSetU64 mEvaluatingAtoms;
+    SmallPairedHashSetU64 mEvaluatingMoves;
     GapsRandomState *mRandState;
     mutable GapsRng mRng;
     uint64_t mMinAtoms;
     uint64_t mMaxAtoms;
+    uint64_t mEvaluatingMinAtoms; // updated as proposals are accepted/rejected
+    uint64_t mEvaluatingMaxAtoms;
+    uint64_t mHandOffMinAtoms; // bounds at the time the queue was handed off
+    uint64_t mHandOffMaxAtoms;
     uint64_t mBinLength; // length of single bin
     uint64_t mNumCols;
     double mAlpha;
@@ -70,6 +117,8 @@ private:
     float mU2;
     unsigned mNumProcessed;
     bool mUseCachedRng;
+    bool mSpeculative; // keep filling the queue past conflicts
+    bool mEvaluating; // a queue has been handed off to the sampler
 };
 
 #endif // __COGAPS_PROPOSAL_QUEUE_H__
\ No newline at end of file
@@ -0,0 +1,113 @@
+#include "catch.h"
+#include "../data_structures/Bfloat16Matrix.h"
+#include "../data_structures/Matrix.h"
+#include "../math/Random.h"
+#include "../math/SIMD.h"
+#include "../math/SIMDDispatch.h"
+
+#include <cmath>
+
+TEST_CASE("Test Bfloat16Matrix.h")
+{
+    GapsRandomState randState(123);
+    GapsRng rng(&randState);
+
+    SECTION("Conversion")
+    {
+        // values with at most 8 significant bits are exact
+        REQUIRE(gaps::fromBfloat16(gaps::toBfloat16(0.f)) == 0.f);
+        REQUIRE(gaps::fromBfloat16(gaps::toBfloat16(1.f)) == 1.f);
+        REQUIRE(gaps::fromBfloat16(gaps::toBfloat16(0.01171875f)) == 0.01171875f);
+        REQUIRE(gaps::fromBfloat16(gaps::toBfloat16(-96.f)) == -96.f);
+
+        // everything else is rounded to the nearest value
+        for (unsigned n = 0; n < 1000; ++n)
+        {
+            float f = rng.uniform(0.01f, 100.f);
+            float b = gaps::fromBfloat16(gaps::toBfloat16(f));
+            REQUIRE(std::abs(b - f) <= f / 256.f);
+        }
+    }
+
+    SECTION("Construction")
+    {
+        Matrix mat(37, 5);
+        for (unsigned i = 0; i < mat.nRow(); ++i)
+        {
+            for (unsigned j = 0; j < mat.nCol(); ++j)
+            {
+                mat(i,j) = rng.uniform(0.f, 10.f);
+            }
+        }
+        Bfloat16Matrix compressed(mat, 1.f);
+        REQUIRE(compressed.nRow() == 37);
+        REQUIRE(compressed.nCol() == 5);
+        REQUIRE(!compressed.empty());
+        REQUIRE(Bfloat16Matrix().empty());
+        for (unsigned i = 0; i < mat.nRow(); ++i)
+        {
+            for (unsigned j = 0; j < mat.nCol(); ++j)
+            {
+                REQUIRE(compressed(i,j) == Approx(mat(i,j)).epsilon(0.004));
+            }
+        }
+
+        // columns are padded with the given value
+        unsigned paddedRows = SIMD_PAD_WIDTH * (1 + 37 / SIMD_PAD_WIDTH);
+        REQUIRE(gaps::fromBfloat16(compressed.colPtr(2)[37]) == 1.f);
+        REQUIRE(gaps::fromBfloat16(compressed.colPtr(2)[paddedRows - 1]) == 1.f);
+    }
+
+    SECTION("Alpha parameters")
+    {
+        Matrix data(1000, 2), invSSq(1000, 2), AP(1000, 2), other(1000, 1);
+        for (unsigned i = 0; i < data.nRow(); ++i)
+        {
+            for (unsigned j = 0; j < data.nCol(); ++j)
+            {
+                data(i,j) = rng.uniform(0.f, 10.f);
+                invSSq(i,j) = rng.uniform(0.01f, 1.f);
+                AP(i,j) = rng.uniform(0.f, 10.f);
+            }
+            other(i,0) = rng.uniform(0.f, 2.f);
+        }
+        invSSq.pad(1.f);
+        Bfloat16Matrix compressedData(data, 0.f), compressedInvSSq(invSSq, 1.f);
+
+        // the bfloat16 kernels agree with the float kernels for every
+        // instruction set, up to the rounding of the stored values
+        for (unsigned set = gaps::simd::INSTRUCTION_SET_SCALAR;
+        set <= gaps::simd::bestInstructionSet(); ++set)
+        {
+            REQUIRE(gaps::simd::setInstructionSet(static_cast<gaps::simd::InstructionSet>(set)));
+            const gaps::simd::KernelTable &k(gaps::simd::kernels());
+
+            float s = 0.f, s_mu = 0.f, sBf16 = 0.f, s_muBf16 = 0.f;
+            k.alphaParameters(other.getCol(0).ptr(), data.getCol(0).ptr(),
+                invSSq.getCol(0).ptr(), AP.getCol(0).ptr(), 1000, &s, &s_mu);
+            k.alphaParametersBf16(other.getCol(0).ptr(), compressedData.colPtr(0),
+                compressedInvSSq.colPtr(0), AP.getCol(0).ptr(), 1000, &sBf16, &s_muBf16);
+            REQUIRE(sBf16 == Approx(s).epsilon(0.01));
+            REQUIRE(s_muBf16 == Approx(s_mu).epsilon(0.01).margin(1.f));
+
+            k.alphaParametersWithChange(other.getCol(0).ptr(), data.getCol(0).ptr(),
+                invSSq.getCol(0).ptr(), AP.getCol(0).ptr(), 0.5f, 1000, &s, &s_mu);
+            k.alphaParametersWithChangeBf16(other.getCol(0).ptr(), compressedData.colPtr(0),
+                compressedInvSSq.colPtr(0), AP.getCol(0).ptr(), 0.5f, 1000, &sBf16, &s_muBf16);
+            REQUIRE(sBf16 == Approx(s).epsilon(0.01));
+            REQUIRE(s_muBf16 == Approx(s_mu).epsilon(0.01).margin(1.f));
+
+            k.alphaParametersPair(other.getCol(0).ptr(), data.getCol(0).ptr(),
+                invSSq.getCol(0).ptr(), AP.getCol(0).ptr(), other.getCol(0).ptr(),
+                data.getCol(1).ptr(), invSSq.getCol(1).ptr(), AP.getCol(1).ptr(),
+                1000, &s, &s_mu);
+            k.alphaParametersPairBf16(other.getCol(0).ptr(), compressedData.colPtr(0),
+                compressedInvSSq.colPtr(0), AP.getCol(0).ptr(), other.getCol(0).ptr(),
+                compressedData.colPtr(1), compressedInvSSq.colPtr(1), AP.getCol(1).ptr(),
+                1000, &sBf16, &s_muBf16);
+            REQUIRE(sBf16 == Approx(s).epsilon(0.01));
+            REQUIRE(s_muBf16 == Approx(s_mu).epsilon(0.01).margin(1.f));
+        }
+        REQUIRE(gaps::simd::setInstructionSet(gaps::simd::bestInstructionSet()));
+    }
+}
@@ -0,0 +1,182 @@
+#include "catch.h"
+#include "../atomic/ConcurrentAtom.h"
+#include "../atomic/ConcurrentAtomMap.h"
+#include "../math/Random.h"
+#include "../utils/GapsPrint.h"
+
+#include <algorithm>
+#include <vector>
+
+TEST_CASE("ConcurrentAtomMap")
+{
+    GapsRandomState randState(123);
+    GapsRng rng(&randState);
+
+    SECTION("Construction")
+    {
+        ConcurrentAtomMapType map;
+        REQUIRE(map.size() == 0);
+        REQUIRE(!map.contains(1));
+    }
+
+    SECTION("Insert finds neighbors")
+    {
+        // insert enough atoms to force several blocks to be split
+        ConcurrentAtomMapType map;
+        std::vector<ConcurrentAtom*> atoms;
+        std::vector<uint64_t> sorted;
+        for (unsigned i = 0; i < 2000; ++i)
+        {
+            uint64_t pos = rng.uniform64(1, 1000000);
+            while (map.contains(pos))
+            {
+                pos = rng.uniform64(1, 1000000);
+            }
+            ConcurrentAtom *atom = new ConcurrentAtom(pos, 1.f);
+            ConcurrentAtom *left = NULL, *right = NULL;
+            map.insert(atom, &left, &right);
+            atoms.push_back(atom);
+
+            std::vector<uint64_t>::iterator it = std::lower_bound(sorted.begin(),
+                sorted.end(), pos);
+            REQUIRE((left == NULL) == (it == sorted.begin()));
+            REQUIRE((right == NULL) == (it == sorted.end()));
+            if (left != NULL)
+            {
+                REQUIRE(left->pos() == *(it - 1));
+            }
+            if (right != NULL)
+            {
+                REQUIRE(right->pos() == *it);
+            }
+            sorted.insert(it, pos);
+            REQUIRE(map.size() == sorted.size());
+            REQUIRE(map.front()->pos() == sorted[0]);
+        }
+
+        for (unsigned i = 0; i < atoms.size(); ++i)
+        {
+            REQUIRE(map.contains(atoms[i]->pos()));
+            map.erase(atoms[i]);
+            REQUIRE(!map.contains(atoms[i]->pos()));
+            delete atoms[i];
+        }
+        REQUIRE(map.size() == 0);
+    }
+
+    SECTION("Update position")
+    {
+        ConcurrentAtomMapType map;
+        std::vector<ConcurrentAtom*> atoms;
+        for (unsigned i = 0; i < 500; ++i)
+        {
+            ConcurrentAtom *atom = new ConcurrentAtom(10 * (i + 1), 1.f);
+            ConcurrentAtom *left = NULL, *right = NULL;
+            map.insert(atom, &left, &right);
+            atoms.push_back(atom);
+        }
+
+        // move every atom within the gap to its right neighbor, this never
+        // changes the order of the atoms
+        #pragma omp parallel for
+        for (unsigned i = 0; i < atoms.size(); ++i)
+        {
+            uint64_t newPos = atoms[i]->pos() + 1 + (i % 8);
+            map.updatePos(atoms[i], newPos);
+            atoms[i]->updatePos(newPos);
+        }
+
+        for (unsigned i = 0; i < atoms.size(); ++i)
+        {
+            uint64_t pos = 10 * (i + 1);
+            REQUIRE(!map.contains(pos));
+            REQUIRE(map.contains(pos + 1 + (i % 8)));
+        }
+        REQUIRE(map.front() == atoms[0]);
+
+        // erase in random order, all remaining atoms must still be found
+        for (unsigned i = atoms.size() - 1; i > 0; --i)
+        {
+            std::swap(atoms[i], atoms[rng.uniform32(0, i)]);
+        }
+        for (unsigned i = 0; i < atoms.size(); ++i)
+        {
+            map.erase(atoms[i]);
+            REQUIRE(map.size() == atoms.size() - i - 1);
+            for (unsigned j = i + 1; j < atoms.size(); j += 37)
+            {
+                REQUIRE(map.contains(atoms[j]->pos()));
+            }
+            delete atoms[i];
+        }
+    }
+}
+
+// optional test used for benchmarking, set to 0 to disable, 1 to enable
+#if 0
+
+// boost time helpers
+#include <boost/date_time/posix_time/posix_time.hpp>
+namespace bpt = boost::posix_time;
+#define bpt_now() bpt::microsec_clock::local_time()
+
+TEST_CASE("Benchmark ConcurrentAtomMap")
+{
+    GapsRandomState randState(123);
+    GapsRng rng(&randState);
+
+    // mimic the sampler: insert/erase mixed with membership queries and moves
+    // on a domain with a steady state of roughly 10,000 atoms
+    const uint64_t domainLength = 1000000000;
+    ConcurrentAtomMapType map;
+    std::vector<ConcurrentAtom*> atoms;
+    bpt::ptime start = bpt_now();
+    for (unsigned n = 0; n < 2000000; ++n)
+    {
+        float u = rng.uniform();
+        if (atoms.size() < 10000 && u < 0.5f)
+        {
+            uint64_t pos = rng.uniform64(1, domainLength);
+            while (map.contains(pos))
+            {
+                pos = rng.uniform64(1, domainLength);
+            }
+            ConcurrentAtom *atom = new ConcurrentAtom(pos, 1.f);
+            ConcurrentAtom *left = NULL, *right = NULL;
+            map.insert(atom, &left, &right);
+            atom->setIndex(atoms.size());
+            atoms.push_back(atom);
+        }
+        else if (!atoms.empty() && u < 0.75f)
+        {
+            unsigned i = rng.uniform32(0, atoms.size() - 1);
+            ConcurrentAtom *atom = atoms[i];
+            map.erase(atom);
+            atoms[i] = atoms.back();
+            atoms.pop_back();
+            delete atom;
+        }
+        else if (!atoms.empty())
+        {
+            ConcurrentAtom *atom = atoms[rng.uniform32(0, atoms.size() - 1)];
+            uint64_t newPos = atom->pos() + 1;
+            if (!map.contains(newPos) && newPos < domainLength)
+            {
+                map.updatePos(atom, newPos);
+                atom->updatePos(newPos);
+            }
+        }
+    }
+    bpt::time_duration diff = bpt_now() - start;
+    gaps_printf("-------\n-------\n-------\n-------\n");
+    gaps_printf("size: %lu\n", map.size());
+    gaps_printf("time: %lu\n", diff.total_milliseconds());
+    gaps_printf("-------\n-------\n-------\n-------\n");
+
+    for (unsigned i = 0; i < atoms.size(); ++i)
+    {
+        delete atoms[i];
+    }
+}
+
+#endif
@@ -0,0 +1,64 @@
+#include "catch.h"
+#include "../atomic/ConcurrentAtom.h"
+#include "../atomic/ConcurrentAtomSlab.h"
+
+#include <vector>
+
+TEST_CASE("ConcurrentAtomSlab")
+{
+    SECTION("Construction")
+    {
+        ConcurrentAtomSlab slab;
+        REQUIRE(slab.size() == 0);
+        REQUIRE(slab.capacity() == 0);
+    }
+
+    SECTION("Allocate and release")
+    {
+        ConcurrentAtomSlab slab;
+        std::vector<ConcurrentAtom*> atoms;
+        for (unsigned i = 0; i < 3 * GAPS_ATOM_SLAB_CAPACITY + 1; ++i)
+        {
+            atoms.push_back(slab.allocate(i + 1, static_cast<float>(i)));
+        }
+        REQUIRE(slab.size() == atoms.size());
+        REQUIRE(slab.capacity() == 4 * GAPS_ATOM_SLAB_CAPACITY);
+
+        // atoms in the same slab are contiguous
+        REQUIRE(atoms[1] == atoms[0] + 1);
+        for (unsigned i = 0; i < atoms.size(); ++i)
+        {
+            REQUIRE(atoms[i]->pos() == i + 1);
+            REQUIRE(atoms[i]->mass() == static_cast<float>(i));
+            REQUIRE(!atoms[i]->hasLeft());
+            REQUIRE(!atoms[i]->hasRight());
+        }
+
+        // released memory is reused before the slab grows
+        slab.release(atoms[10]);
+        slab.release(atoms[20]);
+        REQUIRE(slab.size() == atoms.size() - 2);
+        ConcurrentAtom *a = slab.allocate(100, 1.f);
+        ConcurrentAtom *b = slab.allocate(200, 2.f);
+        REQUIRE(a == atoms[20]);
+        REQUIRE(b == atoms[10]);
+        REQUIRE(a->pos() == 100);
+        REQUIRE(b->mass() == 2.f);
+        REQUIRE(slab.capacity() == 4 * GAPS_ATOM_SLAB_CAPACITY);
+    }
+
+    SECTION("Reserve")
+    {
+        ConcurrentAtomSlab slab;
+        slab.allocate(1, 1.f);
+        slab.reserve(5000);
+        uint64_t capacity = slab.capacity();
+        REQUIRE(capacity - slab.size() >= 5000);
+        for (unsigned i = 0; i < 5000; ++i)
+        {
+            slab.allocate(i + 2, 1.f);
+        }
+        REQUIRE(slab.capacity() == capacity);
+        REQUIRE(slab.size() == 5001);
+    }
+}
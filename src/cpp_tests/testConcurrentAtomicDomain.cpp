@@ -1,15 +1,168 @@
 #include "catch.h"
 #include "../atomic/ConcurrentAtomicDomain.h"
+#include "../atomic/ProposalQueue.h"
+#include "../math/Random.h"
 #include "../utils/GapsPrint.h"
 
-TEST_CASE("AtomicDomain")
+#include <vector>
+
+TEST_CASE("ConcurrentAtomicDomain")
 {
     GapsRandomState randState(123);
     GapsRng rng(&randState);
 
     SECTION("Construction")
     {
-        AtomicDomain domain(10);
+        ConcurrentAtomicDomain domain(10);
+        REQUIRE(domain.size() == 0);
+    }
+
+    SECTION("Empty erase cache")
+    {
+        ConcurrentAtomicDomain domain(10);
+        domain.reserveEraseCache(100);
+        domain.flushEraseCache();
+        REQUIRE(domain.size() == 0);
+    }
+
+    SECTION("Empty move cache")
+    {
+        ConcurrentAtomicDomain domain(10);
+        domain.reserveMoveCache(100);
+        domain.flushMoveCache();
         REQUIRE(domain.size() == 0);
     }
-}
\ No newline at end of file
+}
+
+// evaluate a queue the way the asynchronous sampler does, births and moves
+// are always accepted and deaths always succeed
+static void evaluateQueue(ProposalQueue &queue, ConcurrentAtomicDomain &domain)
+{
+    for (unsigned i = 0; i < queue.size(); ++i)
+    {
+        switch (queue[i].type)
+        {
+            case 'B':
+                queue.acceptBirth();
+                queue[i].atom1->updateMass(1.f);
+                break;
+            case 'D':
+                queue.acceptDeath();
+                domain.cacheErase(queue[i].atom1);
+                break;
+            case 'M':
+                domain.cacheMove(queue[i].atom1, queue[i].pos);
+                break;
+        }
+    }
+}
+
+TEST_CASE("Pipelined ProposalQueue")
+{
+    const unsigned nRows = 1000;
+    const unsigned nPatterns = 10;
+    GapsRandomState randState(123);
+    ConcurrentAtomicDomain domain(nRows * nPatterns);
+    ProposalQueue queue(nRows * nPatterns, nPatterns, &randState);
+    queue.setAlpha(0.01f);
+    queue.setLambda(0.01f);
+    queue.setSpeculative(true);
+
+    // while the domain fills up the birth/death bounds of the queue being
+    // evaluated can block every proposal, after that each queue populated
+    // during an evaluation must make progress
+    const unsigned nWarmUp = 200;
+    const unsigned nQueues = 2000;
+    unsigned nOverlapped = 0;
+    queue.populate(domain, 64);
+    for (unsigned n = 0; n < nWarmUp + nQueues; ++n)
+    {
+        queue.beginEvaluation();
+        domain.reserveEraseCache(queue.size());
+        domain.reserveMoveCache(queue.size());
+        queue.populate(domain, 64);
+        if (n >= nWarmUp)
+        {
+            REQUIRE(queue.nProcessed() > 0);
+            nOverlapped += queue.nProcessed();
+        }
+        evaluateQueue(queue, domain);
+        domain.flushMoveCache();
+        domain.flushEraseCache();
+        queue.endEvaluation();
+    }
+    REQUIRE(nOverlapped > nQueues);
+}
+
+// optional test used for benchmarking, set to 0 to disable, 1 to enable
+#if 0
+
+#include <omp.h>
+
+// boost time helpers
+#include <boost/date_time/posix_time/posix_time.hpp>
+namespace bpt = boost::posix_time;
+#define bpt_now() bpt::microsec_clock::local_time()
+
+// compares the old critical section against the atomic slot used in
+// cacheErase, roughly half of all proposals in a queue erase an atom
+TEST_CASE("Benchmark Erase Cache")
+{
+    const unsigned queueSize = 64;
+    const unsigned nQueues = 200000;
+    std::vector<ConcurrentAtom*> atoms(queueSize, NULL);
+    for (unsigned i = 0; i < queueSize; ++i)
+    {
+        atoms[i] = reinterpret_cast<ConcurrentAtom*>(i + 1); // never dereferenced
+    }
+
+    gaps_printf("-------\n-------\n-------\n-------\n");
+    for (unsigned nThreads = 1; nThreads <= 64; nThreads *= 2)
+    {
+        std::vector<ConcurrentAtom*> cache;
+        cache.reserve(queueSize);
+        bpt::ptime start = bpt_now();
+        for (unsigned q = 0; q < nQueues; ++q)
+        {
+            #pragma omp parallel for num_threads(nThreads)
+            for (unsigned i = 0; i < queueSize; ++i)
+            {
+                if (i % 2 == 0)
+                {
+                    #pragma omp critical(AtomicInsertOrErase)
+                    {
+                        cache.push_back(atoms[i]);
+                    }
+                }
+            }
+            cache.clear();
+        }
+        bpt::time_duration critical = bpt_now() - start;
+
+        std::vector<ConcurrentAtom*> slots(queueSize, NULL);
+        unsigned size = 0;
+        start = bpt_now();
+        for (unsigned q = 0; q < nQueues; ++q)
+        {
+            #pragma omp parallel for num_threads(nThreads)
+            for (unsigned i = 0; i < queueSize; ++i)
+            {
+                if (i % 2 == 0)
+                {
+                    unsigned slot = 0;
+                    #pragma omp atomic capture
+                    slot = size++;
+                    slots[slot] = atoms[i];
+                }
+            }
+            size = 0;
+        }
+        bpt::time_duration atomic = bpt_now() - start;
+
+        gaps_printf("threads: %2u critical: %6lu ms atomic: %6lu ms\n", nThreads,
+            critical.total_milliseconds(), atomic.total_milliseconds());
+    }
+    gaps_printf("-------\n-------\n-------\n-------\n");
+}
+
+#endif
\ No newline at end of file
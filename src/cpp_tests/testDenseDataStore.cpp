@@ -0,0 +1,97 @@
+#include "catch.h"
+#include "../GapsParameters.h"
+#include "../data_structures/Matrix.h"
+#include "../gibbs_sampler/DenseDataStore.h"
+
+static Matrix getStoreData(unsigned nrow, unsigned ncol)
+{
+    Matrix data(nrow, ncol);
+    for (unsigned i = 0; i < data.nRow(); ++i)
+    {
+        for (unsigned j = 0; j < data.nCol(); ++j)
+        {
+            data(i,j) = (i + j) % 3 == 0 ? 0.f : static_cast<float>(i + 2 * j);
+        }
+    }
+    return data;
+}
+
+TEST_CASE("Test DenseDataStore.h")
+{
+    Matrix data(getStoreData(25, 10));
+    GapsParameters params(data);
+
+    SECTION("Views")
+    {
+        SharedDenseData store(new DenseDataStore(data, params, true));
+        REQUIRE(store->nRow(false) == 25);
+        REQUIRE(store->nCol(false) == 10);
+        REQUIRE(store->nRow(true) == 10);
+        REQUIRE(store->nCol(true) == 25);
+        REQUIRE(store->isAModel(true));
+        REQUIRE(!store->isAModel(false));
+
+        // the P view is the input itself, the A view is its transpose
+        const Matrix &pView(store->acquire(false));
+        const Matrix &aView(store->acquire(true));
+        REQUIRE(&pView == &data);
+        for (unsigned i = 0; i < data.nRow(); ++i)
+        {
+            for (unsigned j = 0; j < data.nCol(); ++j)
+            {
+                REQUIRE(aView(j,i) == data(i,j));
+            }
+        }
+
+        // a released view is rebuilt from the other one
+        store->release(false);
+        REQUIRE(&(store->acquire(false)) == &data);
+        store->release(true);
+        REQUIRE(store->acquire(true)(3,7) == data(7,3));
+    }
+
+    SECTION("Copies")
+    {
+        // without referencing the input, every view is a copy
+        SharedDenseData store(new DenseDataStore(data, params));
+        const Matrix &aView(store->acquire(true));
+        const Matrix &pView(store->acquire(false));
+        REQUIRE(&pView != &data);
+        REQUIRE(pView(7,3) == data(7,3));
+        REQUIRE(aView(3,7) == data(7,3));
+    }
+
+    SECTION("Fixed A")
+    {
+        // the dimensions come from the P view, so asking the A model's
+        // dimensions never builds the A view
+        SharedDenseData store(new DenseDataStore(data, params));
+        REQUIRE(store->nRow(true) == 10);
+        REQUIRE(store->nCol(true) == 25);
+        REQUIRE(!store->hasView(true));
+        REQUIRE(store->hasView(false));
+        store->acquire(true);
+        REQUIRE(store->hasView(true));
+    }
+
+    SECTION("Statistics")
+    {
+        SharedDenseData storeA(new DenseDataStore(data, params));
+        SharedDenseData storeP(new DenseDataStore(data, params));
+        storeA->nRow(true);
+        storeP->nRow(false);
+        REQUIRE(storeA->max() == storeP->max());
+        REQUIRE(storeA->sparsity() == storeP->sparsity());
+        REQUIRE(storeA->nonZeroMean() == Approx(storeP->nonZeroMean()));
+    }
+
+    SECTION("Shared handles")
+    {
+        SharedDenseData store(new DenseDataStore(data, params));
+        SharedDenseData copy(store);
+        SharedDenseData other(new DenseDataStore(data, params));
+        other = store;
+        REQUIRE(copy->nRow(false) == 25);
+        REQUIRE(other->nCol(false) == 10);
+    }
+}
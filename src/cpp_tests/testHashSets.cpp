@@ -24,6 +24,20 @@ TEST_CASE("Test HashSets.h - FixedHashSetU32")
         REQUIRE(!hSet.contains(u));
         REQUIRE(hSet.isEmpty());
     }
+
+    // swapping keeps each set's contents, even though the sets have been
+    // cleared a different number of times
+    FixedHashSetU32 otherSet(1000);
+    hSet.insert(5);
+    otherSet.insert(7);
+    hSet.swap(otherSet);
+    REQUIRE(hSet.contains(7));
+    REQUIRE(!hSet.contains(5));
+    REQUIRE(otherSet.contains(5));
+    REQUIRE(!otherSet.contains(7));
+    otherSet.clear();
+    REQUIRE(otherSet.isEmpty());
+    REQUIRE(hSet.contains(7));
 }
 
 TEST_CASE("Test HashSets.h - SmallHashSetU64")
@@ -300,6 +300,7 @@ TEST_CASE("ProposalQueue Serialization")
     for (unsigned i = 0; i < nIterations; ++i)
     {
         queueWrite.populate(domainWrite, nIterations);
+        queueWrite.beginEvaluation();
         for (unsigned j = 0; j < queueWrite.size(); ++j)
         {
             switch (queueWrite[j].type)
@@ -322,7 +323,7 @@ TEST_CASE("ProposalQueue Serialization")
                     break;
             }
         }
-        queueWrite.clear();
+        queueWrite.endEvaluation();
     }
 
     {
@@ -374,6 +375,8 @@ TEST_CASE("ProposalQueue Serialization")
     {
         queueWrite.populate(domainWrite, nIterations);
         queueRead.populate(domainRead, nIterations);
+        queueWrite.beginEvaluation();
+        queueRead.beginEvaluation();
         REQUIRE(queueWrite.size() == queueRead.size());
 
         for (unsigned j = 0; j < queueWrite.size(); ++j)
@@ -438,8 +441,8 @@ TEST_CASE("ProposalQueue Serialization")
             }
         }
 
-        queueWrite.clear();
-        queueRead.clear();
+        queueWrite.endEvaluation();
+        queueRead.endEvaluation();
     }
 
     // cleanup directory
@@ -0,0 +1,196 @@
+#include "catch.h"
+#include "../GapsParameters.h"
+#include "../data_structures/Matrix.h"
+#include "../gibbs_sampler/SparseNormalModel.h"
+#include "../math/Math.h"
+#include "../math/Random.h"
+
+#define TEST_APPROX(x) Approx(x).epsilon(0.0001f).margin(0.0001f)
+
+// exposes the cached state of the model so it can be compared against a
+// dense recomputation
+class TestSparseModel : public SparseNormalModel
+{
+public:
+    TestSparseModel(const Matrix &data, bool transpose, const GapsParameters &params)
+        : SparseNormalModel(data, transpose, transpose, params, params.alphaA,
+            params.maxGibbsMassA)
+    {}
+
+    using SparseNormalModel::changeMatrix;
+    using SparseNormalModel::safelyChangeMatrix;
+
+    unsigned nRow() const { return mMatrix.nRow(); }
+    unsigned nCol() const { return mMatrix.nCol(); }
+    float matrix(unsigned i, unsigned j) const { return mMatrix(i,j); }
+
+    // the cached AP values at the non-zeros of each column of the data, and
+    // the position of each of them in the other model, must match AP
+    void checkNonZeros(const TestSparseModel &other) const
+    {
+        for (unsigned j = 0; j < mDMatrix.nCol(); ++j)
+        {
+            const std::vector<unsigned> &indices(mDMatrix.getCol(j).getIndices());
+            REQUIRE(mAPNonZero[j].size() == indices.size());
+            for (unsigned k = 0; k < indices.size(); ++k)
+            {
+                unsigned i = indices[k];
+                const std::vector<unsigned> &otherIndices(
+                    other.mDMatrix.getCol(i).getIndices());
+                REQUIRE(otherIndices[mTransposedPos[j][k]] == j);
+
+                double ap = 0.0;
+                for (unsigned p = 0; p < nCol(); ++p)
+                {
+                    ap += static_cast<double>(matrix(j,p)) * other.matrix(i,p);
+                }
+                REQUIRE(mAPNonZero[j][k] == TEST_APPROX(ap));
+            }
+        }
+    }
+
+    // Z2 is the product of the transpose of the other matrix with itself
+    void checkLookupTables(const TestSparseModel &other) const
+    {
+        for (unsigned p = 0; p < nCol(); ++p)
+        {
+            for (unsigned q = 0; q < nCol(); ++q)
+            {
+                double z2 = 0.0;
+                for (unsigned i = 0; i < other.nRow(); ++i)
+                {
+                    z2 += static_cast<double>(other.matrix(i,p)) * other.matrix(i,q);
+                }
+                REQUIRE(mZ2(p,q) == TEST_APPROX(z2));
+                REQUIRE(mZ2Sum[gaps::min(p,q) * nCol() + gaps::max(p,q)]
+                    == TEST_APPROX(z2));
+                if (p == q)
+                {
+                    REQUIRE(mZ1[p] == TEST_APPROX(z2));
+                }
+            }
+        }
+    }
+};
+
+// the dense chi-square, with an uncertainty of 0.1 at the zeros of the data
+static double denseChiSq(const Matrix &data, const Matrix *unc,
+const TestSparseModel &A, const TestSparseModel &P)
+{
+    double chisq = 0.0;
+    for (unsigned i = 0; i < data.nRow(); ++i)
+    {
+        for (unsigned j = 0; j < data.nCol(); ++j)
+        {
+            double ap = 0.0;
+            for (unsigned p = 0; p < A.nCol(); ++p)
+            {
+                ap += static_cast<double>(A.matrix(i,p)) * P.matrix(j,p);
+            }
+            double d = data(i,j);
+            double s = d == 0.0 ? 0.1 : (unc != NULL ? (*unc)(i,j) : 0.1 * d);
+            chisq += (d - ap) * (d - ap) / (s * s);
+        }
+    }
+    return chisq;
+}
+
+static Matrix getRandomMatrix(unsigned nrow, unsigned ncol, GapsRng *rng)
+{
+    Matrix mat(nrow, ncol);
+    for (unsigned i = 0; i < nrow; ++i)
+    {
+        for (unsigned j = 0; j < ncol; ++j)
+        {
+            mat(i,j) = rng->uniform(0.f, 2.f);
+        }
+    }
+    return mat;
+}
+
+// a few changes to random rows, safelyChangeMatrix may remove mass
+static void changeModel(TestSparseModel *model, unsigned nChanges, GapsRng *rng)
+{
+    for (unsigned n = 0; n < nChanges; ++n)
+    {
+        unsigned row = rng->uniform32(0, model->nRow() - 1);
+        unsigned col = rng->uniform32(0, model->nCol() - 1);
+        if (rng->uniform() < 0.5f)
+        {
+            model->changeMatrix(row, col, rng->uniform(0.f, 1.f));
+        }
+        else
+        {
+            model->safelyChangeMatrix(row, col, rng->uniform(-1.f, 1.f));
+        }
+    }
+}
+
+static void checkModels(const Matrix &data, const Matrix *unc,
+const TestSparseModel &A, const TestSparseModel &P)
+{
+    double chisq = denseChiSq(data, unc, A, P);
+    REQUIRE(A.chiSq() == Approx(chisq).epsilon(0.0001f));
+    REQUIRE(P.chiSq() == Approx(chisq).epsilon(0.0001f));
+    A.checkNonZeros(P);
+    P.checkNonZeros(A);
+    A.checkLookupTables(P);
+    P.checkLookupTables(A);
+}
+
+TEST_CASE("Test SparseNormalModel.h")
+{
+    GapsRandomState randState(123);
+    GapsRng rng(&randState);
+
+    // genes by samples, about a third of the values are non-zero
+    Matrix data(150, 40);
+    for (unsigned i = 0; i < data.nRow(); ++i)
+    {
+        for (unsigned j = 0; j < data.nCol(); ++j)
+        {
+            data(i,j) = rng.uniform() < 0.33f ? rng.uniform(1.f, 14.f) : 0.f;
+        }
+    }
+    Matrix unc(data.nRow(), data.nCol());
+    for (unsigned i = 0; i < unc.nRow(); ++i)
+    {
+        for (unsigned j = 0; j < unc.nCol(); ++j)
+        {
+            unc(i,j) = rng.uniform(0.5f, 3.f);
+        }
+    }
+
+    GapsParameters params(data);
+    params.nPatterns = 5;
+    params.useSparseOptimization = true;
+
+    for (unsigned withUnc = 0; withUnc < 2; ++withUnc)
+    {
+        const Matrix *uncPtr = withUnc ? &unc : NULL;
+        TestSparseModel A(data, true, params);
+        TestSparseModel P(data, false, params);
+        if (withUnc)
+        {
+            A.setUncertainty(unc, true, true, params);
+            P.setUncertainty(unc, false, false, params);
+        }
+        A.setMatrix(getRandomMatrix(data.nRow(), params.nPatterns, &rng));
+        P.setMatrix(getRandomMatrix(data.nCol(), params.nPatterns, &rng));
+        A.sync(P);
+        P.sync(A);
+        A.extraInitialization();
+        P.extraInitialization();
+        checkModels(data, uncPtr, A, P);
+
+        // few changes update the lookup tables, many recompute them
+        for (unsigned round = 0; round < 10; ++round)
+        {
+            changeModel(&A, round % 3 == 2 ? 200 : 3, &rng);
+            P.sync(A);
+            changeModel(&P, round % 3 == 2 ? 50 : 3, &rng);
+            A.sync(P);
+            checkModels(data, uncPtr, A, P);
+        }
+    }
+}
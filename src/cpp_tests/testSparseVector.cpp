@@ -3,6 +3,9 @@
 #include "../math/Random.h"
 #include "../math/Math.h"
 #include "../math/VectorMath.h"
+#include "../utils/Archive.h"
+
+#include <cstdio>
 
 TEST_CASE("Test SparseVector.h")
 {
@@ -59,6 +62,53 @@ TEST_CASE("Test SparseVector.h")
         }
     }
 
+    SECTION("Test sorted indices")
+    {
+        std::vector<float> in_v(1000, 0.f);
+        in_v[3] = 1.f;
+        in_v[64] = 2.f;
+        in_v[500] = 3.f;
+        SparseVector sv(in_v);
+
+        REQUIRE(sv.getIndices().size() == 3);
+        REQUIRE(sv.getIndices()[0] == 3);
+        REQUIRE(sv.getIndices()[1] == 64);
+        REQUIRE(sv.getIndices()[2] == 500);
+        REQUIRE(sv.getData()[1] == 2.f);
+        REQUIRE(sv.preferIndices());
+
+        std::vector<float> dense_v(1000, 1.f);
+        REQUIRE(!SparseVector(dense_v).preferIndices());
+    }
+
+    SECTION("Test loading from an archive")
+    {
+        std::vector<float> in_v(1000, 0.f);
+        in_v[3] = 1.f;
+        in_v[64] = 2.f;
+        in_v[500] = 3.f;
+        {
+            Archive ar("test_sv.temp", ARCHIVE_WRITE);
+            ar << SparseVector(in_v);
+        }
+
+        // the loaded vector starts out dense, its indices must be replaced
+        SparseVector sv(std::vector<float>(1000, 1.f));
+        {
+            Archive ar("test_sv.temp", ARCHIVE_READ);
+            ar >> sv;
+        }
+        std::remove("test_sv.temp");
+
+        REQUIRE(sv.nElements() == 3);
+        REQUIRE(sv.getIndices().size() == 3);
+        REQUIRE(sv.getIndices()[1] == 64);
+        REQUIRE(sv.getData()[2] == 3.f);
+        REQUIRE(sv.at(500) == 3.f);
+        REQUIRE(sv.at(4) == 0.f);
+        REQUIRE(sv.preferIndices());
+    }
+
 #if 0
     SECTION("bit flags set correctly")
     {
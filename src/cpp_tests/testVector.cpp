@@ -1,7 +1,10 @@
 #include "catch.h"
+#include "../data_structures/Matrix.h"
 #include "../data_structures/Vector.h"
+#include "../math/MatrixMath.h"
 #include "../math/Random.h"
 #include "../math/VectorMath.h"
+#include "../math/SIMDDispatch.h"
 
 // optional test used for benchmarking, set to 0 to disable, 1 to enable
 #if 0
@@ -85,4 +88,173 @@ TEST_CASE("Test Vector.h")
         v += v;
         REQUIRE(gaps::sum(v) == 2.f * s);
     }
-}
\ No newline at end of file
+}
+
+TEST_CASE("Test SIMD kernel dispatch")
+{
+    GapsRandomState randState(123);
+    GapsRng rng(&randState);
+
+    // sizes that are not a multiple of any vector width
+    const unsigned sizes[] = {1, 7, 16, 33, 1000};
+    for (unsigned n = 0; n < 5; ++n)
+    {
+        Vector v1(sizes[n]), v2(sizes[n]), v3(sizes[n]), w(sizes[n]);
+        for (unsigned i = 0; i < sizes[n]; ++i)
+        {
+            v1[i] = rng.uniform(0.f, 10.f);
+            v2[i] = rng.uniform(0.f, 10.f);
+            v3[i] = rng.uniform(0.f, 10.f);
+            w[i] = rng.uniform(0.25f, 1.f); // 1 / S^2
+        }
+        w.pad(1.f); // same as the model
+
+        gaps::simd::KernelTable scalar = gaps::simd::scalarKernels();
+        float dot = scalar.dot(v1.ptr(), v2.ptr(), sizes[n]);
+        float dotDiff = scalar.dotDiff(v1.ptr(), v2.ptr(), v3.ptr(), sizes[n]);
+        float s = 0.f, s_mu = 0.f;
+        scalar.alphaParametersDiff(v1.ptr(), v2.ptr(), v3.ptr(), w.ptr(),
+            v2.ptr(), sizes[n], &s, &s_mu);
+
+        // every instruction set the cpu supports must agree with the scalar kernels
+        for (unsigned set = gaps::simd::INSTRUCTION_SET_SCALAR;
+        set <= gaps::simd::bestInstructionSet(); ++set)
+        {
+            REQUIRE(gaps::simd::setInstructionSet(static_cast<gaps::simd::InstructionSet>(set)));
+            REQUIRE(gaps::simd::kernels().instructionSet == set);
+            REQUIRE(gaps::dot(v1, v2) == Approx(dot).epsilon(0.001));
+            REQUIRE(gaps::dot_diff(v1, v2, v3) == Approx(dotDiff).epsilon(0.001).margin(0.01));
+
+            float s2 = 0.f, s_mu2 = 0.f;
+            gaps::simd::kernels().alphaParametersDiff(v1.ptr(), v2.ptr(),
+                v3.ptr(), w.ptr(), v2.ptr(), sizes[n], &s2, &s_mu2);
+            REQUIRE(s2 == Approx(s).epsilon(0.001).margin(0.01));
+            REQUIRE(s_mu2 == Approx(s_mu).epsilon(0.001).margin(0.01));
+
+            // fused kernel for two columns matches two separate passes
+            float s1 = 0.f, s_mu1 = 0.f, sPair = 0.f, s_muPair = 0.f;
+            gaps::simd::kernels().alphaParameters(v1.ptr(), v2.ptr(), w.ptr(),
+                v3.ptr(), sizes[n], &s1, &s_mu1);
+            gaps::simd::kernels().alphaParameters(v2.ptr(), v3.ptr(), w.ptr(),
+                v1.ptr(), sizes[n], &s2, &s_mu2);
+            gaps::simd::kernels().alphaParametersPair(v1.ptr(), v2.ptr(),
+                w.ptr(), v3.ptr(), v2.ptr(), v3.ptr(), w.ptr(), v1.ptr(),
+                sizes[n], &sPair, &s_muPair);
+            REQUIRE(sPair == Approx(s1 + s2).epsilon(0.001).margin(0.01));
+            REQUIRE(s_muPair == Approx(s_mu1 - s_mu2).epsilon(0.001).margin(0.01));
+
+            // compensated sum is as accurate as summing in double precision
+            double chisq = 0.0;
+            for (unsigned i = 0; i < sizes[n]; ++i)
+            {
+                double diff = static_cast<double>(v1[i]) - v2[i];
+                chisq += diff * diff * w[i];
+            }
+            REQUIRE(gaps::simd::kernels().chiSq(v1.ptr(), w.ptr(), v2.ptr(),
+                sizes[n]) == Approx(chisq).epsilon(0.000001));
+
+            // the fused update returns the change in chi-square
+            Vector ap(v2);
+            double change = gaps::simd::kernels().addScaledChiSq(ap.ptr(),
+                v3.ptr(), 0.1f, v1.ptr(), w.ptr(), sizes[n]);
+            double newChisq = 0.0;
+            for (unsigned i = 0; i < sizes[n]; ++i)
+            {
+                REQUIRE(ap[i] == Approx(v2[i] + 0.1f * v3[i]));
+                double diff = static_cast<double>(v1[i]) - ap[i];
+                newChisq += diff * diff * w[i];
+            }
+            REQUIRE(change == Approx(newChisq - chisq).epsilon(0.0001).margin(0.01));
+        }
+    }
+    REQUIRE(gaps::simd::setInstructionSet(gaps::simd::bestInstructionSet()));
+    REQUIRE(!gaps::simd::instructionSetName(gaps::simd::kernels().instructionSet).empty());
+}
+
+TEST_CASE("Test blocked transpose")
+{
+    GapsRandomState randState(123);
+    GapsRng rng(&randState);
+
+    // sizes that leave partial tiles and partial blocks at the edges
+    const unsigned nRows[] = {1, 8, 13, 64, 150};
+    const unsigned nCols[] = {1, 16, 9, 200, 67};
+    for (unsigned n = 0; n < 5; ++n)
+    {
+        Matrix mat(nRows[n], nCols[n]);
+        for (unsigned i = 0; i < mat.nRow(); ++i)
+        {
+            for (unsigned j = 0; j < mat.nCol(); ++j)
+            {
+                mat(i,j) = rng.uniform(0.f, 10.f);
+            }
+        }
+
+        for (unsigned set = gaps::simd::INSTRUCTION_SET_SCALAR;
+        set <= gaps::simd::bestInstructionSet(); ++set)
+        {
+            REQUIRE(gaps::simd::setInstructionSet(static_cast<gaps::simd::InstructionSet>(set)));
+            Matrix matT(mat.nCol(), mat.nRow());
+            gaps::transpose(mat, &matT);
+            Matrix matTT(mat, true, false, std::vector<unsigned>());
+            for (unsigned i = 0; i < mat.nRow(); ++i)
+            {
+                for (unsigned j = 0; j < mat.nCol(); ++j)
+                {
+                    REQUIRE(matT(j,i) == mat(i,j));
+                    REQUIRE(matTT(j,i) == mat(i,j));
+                }
+            }
+        }
+    }
+    REQUIRE(gaps::simd::setInstructionSet(gaps::simd::bestInstructionSet()));
+}
+
+TEST_CASE("Test blocked matrix product")
+{
+    GapsRandomState randState(123);
+    GapsRng rng(&randState);
+
+    // the row block is 512 so the larger sizes span more than one
+    const unsigned nRows[] = {1, 17, 600, 1100};
+    const unsigned nCols[] = {3, 70, 9, 130};
+    const unsigned nInner = 7;
+    for (unsigned n = 0; n < 4; ++n)
+    {
+        Matrix X(nRows[n], nInner), Y(nCols[n], nInner);
+        for (unsigned k = 0; k < nInner; ++k)
+        {
+            for (unsigned i = 0; i < X.nRow(); ++i)
+            {
+                X(i,k) = rng.uniform(0.f, 10.f);
+            }
+            for (unsigned j = 0; j < Y.nRow(); ++j)
+            {
+                Y(j,k) = rng.uniform(0.f, 10.f);
+            }
+        }
+
+        for (unsigned set = gaps::simd::INSTRUCTION_SET_SCALAR;
+        set <= gaps::simd::bestInstructionSet(); ++set)
+        {
+            REQUIRE(gaps::simd::setInstructionSet(static_cast<gaps::simd::InstructionSet>(set)));
+            Matrix C(X.nRow(), Y.nRow()), Ct(Y.nRow(), X.nRow());
+            gaps::multiplyTransposed(X, Y, &C, 2);
+            gaps::multiplyTransposed(Y, X, &Ct);
+            for (unsigned i = 0; i < C.nRow(); ++i)
+            {
+                for (unsigned j = 0; j < C.nCol(); ++j)
+                {
+                    double c = 0.0;
+                    for (unsigned k = 0; k < nInner; ++k)
+                    {
+                        c += static_cast<double>(X(i,k)) * Y(j,k);
+                    }
+                    REQUIRE(C(i,j) == Approx(c).epsilon(0.0001));
+                    REQUIRE(Ct(j,i) == C(i,j)); // exactly the same
+                }
+            }
+        }
+    }
+    REQUIRE(gaps::simd::setInstructionSet(gaps::simd::bestInstructionSet()));
+}
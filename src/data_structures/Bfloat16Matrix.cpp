@@ -0,0 +1,71 @@
+#include "Bfloat16Matrix.h"
+#include "Matrix.h"
+#include "../math/SIMD.h"
+#include "../utils/GapsAssert.h"
+
+#include <cstring>
+
+#define SIMD_PAD(x) (SIMD_PAD_WIDTH + SIMD_PAD_WIDTH * ((x) / SIMD_PAD_WIDTH))
+
+bfloat16_t gaps::toBfloat16(float f)
+{
+    uint32_t bits = 0;
+    std::memcpy(&bits, &f, sizeof(float));
+    bits += 0x7FFF + ((bits >> 16) & 1); // round half to even
+    return static_cast<bfloat16_t>(bits >> 16);
+}
+
+float gaps::fromBfloat16(bfloat16_t b)
+{
+    uint32_t bits = static_cast<uint32_t>(b) << 16;
+    float f = 0.f;
+    std::memcpy(&f, &bits, sizeof(float));
+    return f;
+}
+
+Bfloat16Matrix::Bfloat16Matrix() : mNumRows(0), mNumCols(0), mColStride(0) {}
+
+Bfloat16Matrix::Bfloat16Matrix(const Matrix &mat, float padValue)
+    :
+mData(static_cast<uint64_t>(SIMD_PAD(mat.nRow())) * mat.nCol(), gaps::toBfloat16(padValue)),
+mNumRows(mat.nRow()),
+mNumCols(mat.nCol()),
+mColStride(SIMD_PAD(mat.nRow()))
+{
+    GAPS_ASSERT((mColStride % SIMD_PAD_WIDTH) == 0);
+    for (unsigned j = 0; j < mNumCols; ++j)
+    {
+        for (unsigned i = 0; i < mNumRows; ++i)
+        {
+            mData[static_cast<uint64_t>(j) * mColStride + i] = gaps::toBfloat16(mat(i,j));
+        }
+    }
+}
+
+unsigned Bfloat16Matrix::nRow() const
+{
+    return mNumRows;
+}
+
+unsigned Bfloat16Matrix::nCol() const
+{
+    return mNumCols;
+}
+
+float Bfloat16Matrix::operator()(unsigned i, unsigned j) const
+{
+    GAPS_ASSERT(i < mNumRows);
+    GAPS_ASSERT(j < mNumCols);
+    return gaps::fromBfloat16(mData[static_cast<uint64_t>(j) * mColStride + i]);
+}
+
+const bfloat16_t* Bfloat16Matrix::colPtr(unsigned j) const
+{
+    GAPS_ASSERT(j < mNumCols);
+    return &(mData[static_cast<uint64_t>(j) * mColStride]);
+}
+
+bool Bfloat16Matrix::empty() const
+{
+    return mNumRows == 0;
+}
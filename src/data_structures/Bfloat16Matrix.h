@@ -0,0 +1,42 @@
+#ifndef __COGAPS_BFLOAT16_MATRIX_H__
+#define __COGAPS_BFLOAT16_MATRIX_H__
+
+#include "Vector.h"
+
+#include <stdint.h>
+#include <vector>
+
+class Matrix;
+
+// bfloat16 is the upper half of a float: the same exponent range with only 8
+// bits of precision, stored as the raw bits
+typedef uint16_t bfloat16_t;
+typedef std::vector<bfloat16_t, bal::aligned_allocator<bfloat16_t,64> > aligned_bfloat16_vector;
+
+namespace gaps
+{
+    bfloat16_t toBfloat16(float f); // rounds to nearest even
+    float fromBfloat16(bfloat16_t b);
+} // namespace gaps
+
+// Read only, column major copy of a Matrix in bfloat16, used to halve the
+// memory (and bandwidth) needed for large data sets. Columns are padded the
+// same way as Vector so the SIMD kernels can read them directly.
+class Bfloat16Matrix
+{
+public:
+    Bfloat16Matrix();
+    Bfloat16Matrix(const Matrix &mat, float padValue);
+    unsigned nRow() const;
+    unsigned nCol() const;
+    float operator()(unsigned i, unsigned j) const;
+    const bfloat16_t* colPtr(unsigned j) const;
+    bool empty() const;
+private:
+    aligned_bfloat16_vector mData;
+    unsigned mNumRows;
+    unsigned mNumCols;
+    unsigned mColStride;
+};
+
+#endif // __COGAPS_BFLOAT16_MATRIX_H__
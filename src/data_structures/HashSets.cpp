@@ -1,5 +1,7 @@
 #include "HashSets.h"
 
+#include <algorithm>
+
 ///////////////////////////// FixedHashSetU32 //////////////////////////////////
 
 FixedHashSetU32::FixedHashSetU32(unsigned size)
@@ -16,12 +18,12 @@ void FixedHashSetU32::clear()
     ++mCurrentKey;
 }
 
-bool FixedHashSetU32::contains(unsigned n)
+bool FixedHashSetU32::contains(unsigned n) const
 {
     return mSet[n] == mCurrentKey;
 }
 
-bool FixedHashSetU32::isEmpty()
+bool FixedHashSetU32::isEmpty() const
 {
     unsigned sz = mSet.size();
     for (unsigned i = 0; i < sz; ++i)
@@ -34,6 +36,12 @@ bool FixedHashSetU32::isEmpty()
     return true;
 }
 
+void FixedHashSetU32::swap(FixedHashSetU32 &other)
+{
+    mSet.swap(other.mSet);
+    std::swap(mCurrentKey, other.mCurrentKey);
+}
+
 ///////////////////////////// SmallHashSetU64 //////////////////////////////////
 
 SmallHashSetU64::SmallHashSetU64() {}
@@ -66,6 +74,11 @@ bool SmallHashSetU64::isEmpty()
     return mSet.empty();
 }
 
+void SmallHashSetU64::swap(SmallHashSetU64 &other)
+{
+    mSet.swap(other.mSet);
+}
+
 ///////////////////////////// SmallPairedHashSetU64 ////////////////////////////
 
 SmallPairedHashSetU64::SmallPairedHashSetU64() {}
@@ -110,4 +123,9 @@ bool SmallPairedHashSetU64::contains(uint64_t pos) const
 bool SmallPairedHashSetU64::isEmpty()
 {
     return mSet.empty();
+}
+
+void SmallPairedHashSetU64::swap(SmallPairedHashSetU64 &other)
+{
+    mSet.swap(other.mSet);
 }
\ No newline at end of file
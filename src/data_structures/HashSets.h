@@ -10,8 +10,9 @@ public:
     explicit FixedHashSetU32(unsigned size);
     void insert(unsigned n);
     void clear();
-    bool contains(unsigned n);
-    bool isEmpty();
+    bool contains(unsigned n) const;
+    bool isEmpty() const;
+    void swap(FixedHashSetU32 &other);
 private:
     std::vector<uint32_t> mSet;
     uint64_t mCurrentKey;
@@ -25,6 +26,7 @@ public:
     void clear();
     bool contains(uint64_t pos);
     bool isEmpty();
+    void swap(SmallHashSetU64 &other);
 private:
     std::vector<uint64_t> mSet;
 };
@@ -45,6 +47,7 @@ public:
     bool contains(uint64_t pos) const; // endpoint of pair
     bool overlap(uint64_t pos); // this position in between pair
     bool isEmpty();
+    void swap(SmallPairedHashSetU64 &other);
 private:
     std::vector<PositionPair> mSet;
 };
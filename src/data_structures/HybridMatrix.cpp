@@ -1,9 +1,12 @@
 #include "HybridMatrix.h"
 #include "HybridVector.h"
 #include "Matrix.h"
+#include "../math/MatrixMath.h"
 #include "../utils/Archive.h"
 #include "Vector.h"
 
+#include <vector>
+
 HybridMatrix::HybridMatrix(unsigned nrow, unsigned ncol)
     :
 mRows(nrow, Vector(ncol)),
@@ -71,15 +74,29 @@ void HybridMatrix::operator=(const Matrix &mat)
     GAPS_ASSERT(mNumRows == mat.nRow());
     GAPS_ASSERT(mNumCols == mat.nCol());
 
-    for (unsigned i = 0; i < mNumRows; ++i)
+    // the rows are the transpose of the columns of mat
+    if (mNumRows > 0 && mNumCols > 0)
     {
+        std::vector<const float*> matCols(mNumCols);
         for (unsigned j = 0; j < mNumCols; ++j)
         {
-            mRows[i][j] = mat(i,j);
-            mCols[j].add(i, -1.f * mCols[j][i]);
-            mCols[j].add(i, mat(i,j));
+            matCols[j] = mat.getCol(j).ptr();
+        }
+        std::vector<float*> rows(mNumRows);
+        for (unsigned i = 0; i < mNumRows; ++i)
+        {
+            rows[i] = mRows[i].ptr();
         }
-    }    
+        gaps::transpose(&matCols[0], &rows[0], mNumRows, mNumCols);
+    }
+
+    for (unsigned j = 0; j < mNumCols; ++j)
+    {
+        for (unsigned i = 0; i < mNumRows; ++i)
+        {
+            mCols[j].set(i, mat(i,j));
+        }
+    }
 }
 
 Archive& operator<<(Archive &ar, const HybridMatrix &vec)
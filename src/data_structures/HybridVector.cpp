@@ -4,8 +4,7 @@
 #include "../utils/Archive.h"
 #include "../utils/GapsAssert.h"
 
-#define SIMD_PAD(x) (gaps::simd::Index::increment() + \
-    gaps::simd::Index::increment() * ((x) / gaps::simd::Index::increment())) 
+#define SIMD_PAD(x) (SIMD_PAD_WIDTH + SIMD_PAD_WIDTH * ((x) / SIMD_PAD_WIDTH))
 
 HybridVector::HybridVector(unsigned sz)
     :
@@ -13,7 +12,7 @@ mIndexBitFlags(sz / 64 + 1, 0),
 mData(SIMD_PAD(sz), 0.f),
 mSize(sz)
 {
-    GAPS_ASSERT(mData.size() % gaps::simd::Index::increment() == 0);
+    GAPS_ASSERT(mData.size() % SIMD_PAD_WIDTH == 0);
 }
 
 HybridVector::HybridVector(const std::vector<float> &v)
@@ -22,7 +21,7 @@ mIndexBitFlags(v.size() / 64 + 1, 0),
 mData(SIMD_PAD(v.size()), 0.f),
 mSize(v.size())
 {
-    GAPS_ASSERT(mData.size() % gaps::simd::Index::increment() == 0);
+    GAPS_ASSERT(mData.size() % SIMD_PAD_WIDTH == 0);
 
     for (unsigned i = 0; i < mSize; ++i)
     {
@@ -8,9 +8,9 @@
 #include <boost/align/aligned_allocator.hpp>
 #pragma GCC diagnostic pop
 
-// need to align data for SIMD
+// need to align data for SIMD, 64 bytes is enough for AVX-512
 namespace bal = boost::alignment;
-typedef std::vector<float, bal::aligned_allocator<float,32> > aligned_vector;
+typedef std::vector<float, bal::aligned_allocator<float,64> > aligned_vector;
 
 class Archive;
 
@@ -2,12 +2,12 @@
 #include "SparseVector.h"
 #include "../file_parser/FileParser.h"
 #include "../file_parser/MatrixElement.h"
+#include "../math/MatrixMath.h"
 #include "../utils/Archive.h"
 #include "../utils/GapsAssert.h"
 #include "Vector.h"
 
 #include <algorithm>
-#include <iterator>
 
 Matrix::Matrix() : mNumRows(0), mNumCols(0) {}
 
@@ -28,7 +28,7 @@ void Matrix::pad(float val)
 
 // constructor from data set read in as a matrix
 Matrix::Matrix(const Matrix &mat, bool genesInCols, bool subsetGenes,
-std::vector<unsigned> indices)
+std::vector<unsigned> indices, unsigned nThreads)
 {
 #ifdef GAPS_DEBUG
     for (unsigned i = 0; i < indices.size(); ++i)
@@ -46,10 +46,22 @@ std::vector<unsigned> indices)
     unsigned nSamples = (subsetData && !subsetGenes)
         ? indices.size()
         : genesInCols ? mat.nRow() : mat.nCol();
-    
+    mNumRows = nGenes;
+    mNumCols = nSamples;
+
+    // a plain transpose is done in cache sized blocks
+    if (!subsetData && genesInCols)
+    {
+        mCols.resize(nSamples, Vector(nGenes));
+        gaps::transpose(mat, this, nThreads);
+        return;
+    }
+
+    // every column is filled independently
+    mCols.resize(nSamples, Vector(nGenes));
+    #pragma omp parallel for num_threads(nThreads)
     for (unsigned j = 0; j < nSamples; ++j)
     {
-        mCols.push_back(Vector(nGenes));
         for (unsigned i = 0; i < nGenes; ++i)
         {
             unsigned dataRow = (subsetData && (subsetGenes != genesInCols))
@@ -64,13 +76,11 @@ std::vector<unsigned> indices)
             mCols[j][i] = mat(dataRow, dataCol);
         }
     }
-    mNumRows = nGenes;
-    mNumCols = nSamples;
 }
 
 // constructor from data set given as a file path
 Matrix::Matrix(const std::string &path, bool genesInCols, bool subsetGenes,
-std::vector<unsigned> indices)
+std::vector<unsigned> indices, unsigned nThreads)
 {
 #ifdef GAPS_DEBUG
     for (unsigned i = 0; i < indices.size(); ++i)
@@ -97,38 +107,41 @@ std::vector<unsigned> indices)
         mCols.push_back(Vector(mNumRows));
     }
 
-    // read from file
-    if (!subsetData)
+    // read from file, if the parser supports it the blocks of the file are
+    // parsed in parallel - every element has its own position in the matrix
+    // so they can be written without any synchronization
+    std::sort(indices.begin(), indices.end());
+    if (fp.nBlocks() > 0)
     {
-        while (fp.hasNext())
+        bool valid = true;
+        #pragma omp parallel for num_threads(nThreads) schedule(dynamic) reduction(&&:valid)
+        for (unsigned n = 0; n < fp.nBlocks(); ++n)
         {
-            MatrixElement e(fp.getNext());
-            unsigned row = genesInCols ? e.col : e.row;
-            unsigned col = genesInCols ? e.row : e.col;
-            this->operator()(row, col) = e.value;
+            std::vector<MatrixElement> elements;
+            bool blockValid = fp.getBlock(n, &elements);
+            valid = valid && blockValid;
+            for (unsigned k = 0; k < elements.size(); ++k)
+            {
+                unsigned row = 0, col = 0;
+                if (elements[k].position(genesInCols, subsetGenes, indices, &row, &col))
+                {
+                    this->operator()(row, col) = elements[k].value;
+                }
+            }
+        }
+        if (!valid)
+        {
+            GAPS_ERROR("Invalid entry found in input data: " << path);
         }
+        return;
     }
-    else
+    while (fp.hasNext())
     {
-        std::sort(indices.begin(), indices.end());
-        while (fp.hasNext())
+        MatrixElement e(fp.getNext());
+        unsigned row = 0, col = 0;
+        if (e.position(genesInCols, subsetGenes, indices, &row, &col))
         {
-            MatrixElement e(fp.getNext());
-            unsigned searchIndex = 1 + ((subsetGenes != genesInCols) ? e.row : e.col);
-            std::vector<unsigned>::iterator pos = 
-                std::lower_bound(indices.begin(), indices.end(), searchIndex);
-        
-            // this index is included in the subset
-            if (pos != indices.end() && *pos == searchIndex)
-            {
-                unsigned row = subsetGenes
-                    ? std::distance(indices.begin(), pos)
-                    : genesInCols ? e.col : e.row;
-                unsigned col = !subsetGenes
-                    ? std::distance(indices.begin(), pos)
-                    : genesInCols ? e.row : e.col;
-                this->operator()(row, col) = e.value;
-            }
+            this->operator()(row, col) = e.value;
         }
     }
 }
@@ -15,9 +15,9 @@ public:
     Matrix();
     Matrix(unsigned nrow, unsigned ncol);
     Matrix(const Matrix &mat, bool genesInCols, bool subsetGenes,
-        std::vector<unsigned> indices);
+        std::vector<unsigned> indices, unsigned nThreads=1);
     Matrix(const std::string &path, bool genesInCols, bool subsetGenes,
-        std::vector<unsigned> indices);
+        std::vector<unsigned> indices, unsigned nThreads=1);
     unsigned nRow() const;
     unsigned nCol() const;
     void pad(float val);
@@ -1,15 +1,15 @@
 #include "SparseMatrix.h"
 #include "Matrix.h"
 #include "../file_parser/FileParser.h"
+#include "../file_parser/MatrixElement.h"
 #include "../utils/Archive.h"
 #include "../utils/GapsAssert.h"
 
 #include <algorithm>
-#include <iterator>
 
 // constructor from data set read in as a matrix
 SparseMatrix::SparseMatrix(const Matrix &mat, bool genesInCols,
-bool subsetGenes, std::vector<unsigned> indices)
+bool subsetGenes, std::vector<unsigned> indices, unsigned nThreads)
 {
 #ifdef GAPS_DEBUG
     for (unsigned i = 0; i < indices.size(); ++i)
@@ -28,9 +28,12 @@ bool subsetGenes, std::vector<unsigned> indices)
         ? indices.size()
         : genesInCols ? mat.nRow() : mat.nCol();
     
+    // the non-zeros are appended directly, so there is never a dense copy
+    // of a column, and every column is filled independently
+    mCols.resize(nSamples, SparseVector(nGenes));
+    #pragma omp parallel for num_threads(nThreads)
     for (unsigned j = 0; j < nSamples; ++j)
     {
-        std::vector<float> values;
         for (unsigned i = 0; i < nGenes; ++i)
         {
             unsigned dataRow = (subsetData && (subsetGenes != genesInCols))
@@ -41,17 +44,75 @@ bool subsetGenes, std::vector<unsigned> indices)
                 ? indices[genesInCols ? i : j] - 1
                 : genesInCols ? i : j;
 
-            values.push_back(mat(dataRow, dataCol));
+            float value = mat(dataRow, dataCol);
+            if (value > 0.f)
+            {
+                mCols[j].append(i, value);
+            }
         }
-        mCols.push_back(SparseVector(values));
     }
     mNumRows = nGenes;
     mNumCols = nSamples;
 }
 
-// constructor from data set given as a file path
+// Adds a file element to the matrix. Zeros and elements outside the subset
+// are skipped, indices must be sorted.
+void SparseMatrix::readElement(const MatrixElement &e, bool genesInCols,
+bool subsetGenes, const std::vector<unsigned> &indices)
+{
+    unsigned row = 0, col = 0;
+    if (e.value > 0.f && e.position(genesInCols, subsetGenes, indices, &row, &col))
+    {
+        mCols[col].append(row, e.value);
+    }
+}
+
+// Parses the file in waves of nThreads blocks at a time and reads the elements
+// in the order of the file, so only a few blocks are ever held in memory.
+// Parsers that can't be split are read one element at a time.
+void SparseMatrix::readFile(FileParser &fp, bool genesInCols, bool subsetGenes,
+const std::vector<unsigned> &indices, unsigned nThreads)
+{
+    if (fp.nBlocks() == 0)
+    {
+        while (fp.hasNext())
+        {
+            readElement(fp.getNext(), genesInCols, subsetGenes, indices);
+        }
+        return;
+    }
+
+    nThreads = std::max(nThreads, 1u);
+    std::vector< std::vector<MatrixElement> > blocks(nThreads);
+    for (unsigned first = 0; first < fp.nBlocks(); first += nThreads)
+    {
+        unsigned nWave = std::min(nThreads, fp.nBlocks() - first);
+        bool valid = true;
+        #pragma omp parallel for num_threads(nThreads) reduction(&&:valid)
+        for (unsigned n = 0; n < nWave; ++n)
+        {
+            bool blockValid = fp.getBlock(first + n, &blocks[n]);
+            valid = valid && blockValid;
+        }
+        if (!valid)
+        {
+            GAPS_ERROR("Invalid entry found in input data");
+        }
+        for (unsigned n = 0; n < nWave; ++n)
+        {
+            for (unsigned k = 0; k < blocks[n].size(); ++k)
+            {
+                readElement(blocks[n][k], genesInCols, subsetGenes, indices);
+            }
+        }
+    }
+}
+
+// Constructor from data set given as a file path. The file is parsed once,
+// the non-zeros are appended to their columns and the spare capacity of each
+// column is released at the end.
 SparseMatrix::SparseMatrix(const std::string &path, bool genesInCols,
-bool subsetGenes, std::vector<unsigned> indices)
+bool subsetGenes, std::vector<unsigned> indices, unsigned nThreads)
 {
 #ifdef GAPS_DEBUG
     for (unsigned i = 0; i < indices.size(); ++i)
@@ -61,6 +122,7 @@ bool subsetGenes, std::vector<unsigned> indices)
     }
 #endif
 
+    std::sort(indices.begin(), indices.end());
     FileParser fp(path);
 
     // calculate the number of rows and columns
@@ -72,51 +134,17 @@ bool subsetGenes, std::vector<unsigned> indices)
         ? indices.size()
         : genesInCols ? fp.nRow() : fp.nCol();
 
-    // allocate space for the data
+    mCols.reserve(mNumCols);
     for (unsigned j = 0; j < mNumCols; ++j)
     {
         mCols.push_back(SparseVector(mNumRows));
     }
 
-    // read from file
-    if (!subsetData)
-    {
-        while (fp.hasNext())
-        {
-            MatrixElement e(fp.getNext());
-            unsigned row = genesInCols ? e.col : e.row;
-            unsigned col = genesInCols ? e.row : e.col;
-            if (e.value > 0.f)
-            {
-                mCols[col].insert(row, e.value);
-            }
-        }
-    }
-    else
+    readFile(fp, genesInCols, subsetGenes, indices, nThreads);
+    for (unsigned j = 0; j < mNumCols; ++j)
     {
-        std::sort(indices.begin(), indices.end());
-        while (fp.hasNext())
-        {
-            MatrixElement e(fp.getNext());
-            if (e.value > 0.f)
-            {
-                unsigned searchIndex = 1 + ((subsetGenes != genesInCols) ? e.row : e.col);
-                std::vector<unsigned>::iterator pos = 
-                    std::lower_bound(indices.begin(), indices.end(), searchIndex);
-        
-                // this index is included in the subset
-                if (pos != indices.end() && *pos == searchIndex)
-                {
-                    unsigned row = subsetGenes
-                        ? std::distance(indices.begin(), pos)
-                        : genesInCols ? e.col : e.row;
-                    unsigned col = !subsetGenes
-                        ? std::distance(indices.begin(), pos)
-                        : genesInCols ? e.row : e.col;
-                    mCols[col].insert(row, e.value);
-                }
-            }
-        }
+        mCols[j].sortIndices();
+        mCols[j].shrinkToFit();
     }
 }
 
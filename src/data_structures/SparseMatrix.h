@@ -7,7 +7,9 @@
 #include <vector>
 
 class Archive;
+class FileParser;
 class Matrix;
+struct MatrixElement;
 
 // no random access, all data is const, can only access with iterator
 // over a given column
@@ -15,9 +17,9 @@ class SparseMatrix
 {
 public:
     SparseMatrix(const Matrix &mat, bool genesInCols, bool subsetGenes,
-        std::vector<unsigned> indices);
+        std::vector<unsigned> indices, unsigned nThreads=1);
     SparseMatrix(const std::string &path, bool genesInCols, bool subsetGenes,
-        std::vector<unsigned> indices);
+        std::vector<unsigned> indices, unsigned nThreads=1);
     unsigned nRow() const;
     unsigned nCol() const;
     const SparseVector& getCol(unsigned n) const;
@@ -25,6 +27,11 @@ public:
     friend Archive& operator<<(Archive &ar, const SparseMatrix &vec);
     friend Archive& operator>>(Archive &ar, SparseMatrix &vec);
 private:
+    void readElement(const MatrixElement &e, bool genesInCols, bool subsetGenes,
+        const std::vector<unsigned> &indices);
+    void readFile(FileParser &fp, bool genesInCols, bool subsetGenes,
+        const std::vector<unsigned> &indices, unsigned nThreads);
+
     std::vector<SparseVector> mCols;
     unsigned mNumRows;
     unsigned mNumCols;
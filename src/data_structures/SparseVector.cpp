@@ -3,6 +3,9 @@
 #include "../utils/Archive.h"
 #include "../utils/GapsAssert.h"
 
+#include <algorithm>
+#include <utility>
+
 // counts number of bits set below position
 // internal expression clears all bits as high as pos or higher
 // number of remaning bits is returned
@@ -27,6 +30,7 @@ mIndexBitFlags(v.size() / 64 + 1, 0)
         if (v[i] > 0.f)
         {
             mData.push_back(v[i]);
+            mIndices.push_back(i);
             mIndexBitFlags[i / 64] |= (1ull << (i % 64));
         }
     }
@@ -42,6 +46,7 @@ mIndexBitFlags(v.size() / 64 + 1, 0)
         if (v[i] > 0.f)
         {
             mData.push_back(v[i]);
+            mIndices.push_back(i);
             mIndexBitFlags[i / 64] |= (1ull << (i % 64));
         }
     }
@@ -52,18 +57,48 @@ unsigned SparseVector::size() const
     return mSize;
 }
 
-void SparseVector::insert(unsigned i, float v)
+// release the spare capacity left over from appending values
+void SparseVector::shrinkToFit()
+{
+    std::vector<float>(mData).swap(mData);
+    std::vector<unsigned>(mIndices).swap(mIndices);
+}
+
+// values can be appended in any order, sortIndices must be called afterwards
+// if they weren't appended in order of their index
+void SparseVector::append(unsigned i, float v)
 {
     GAPS_ASSERT(v > 0.f);
     GAPS_ASSERT(!(mIndexBitFlags[i / 64] & (1ull << (i % 64)))); // this data should not exist
-    unsigned dataIndex = 0;
-    for (unsigned j = 0; j < i / 64; ++j)
+    mData.push_back(v);
+    mIndices.push_back(i);
+    mIndexBitFlags[i / 64] |= (1ull << (i % 64));
+}
+
+// files are almost always in order, so the data is only copied if needed
+void SparseVector::sortIndices()
+{
+    unsigned n = mIndices.size();
+    unsigned k = 1;
+    while (k < n && mIndices[k - 1] < mIndices[k])
     {
-        dataIndex += __builtin_popcountll(mIndexBitFlags[j]);
+        ++k;
+    }
+    if (k >= n)
+    {
+        return;
+    }
+    std::vector< std::pair<unsigned, float> > pairs(n);
+    for (unsigned i = 0; i < n; ++i)
+    {
+        pairs[i] = std::make_pair(mIndices[i], mData[i]);
+    }
+    std::sort(pairs.begin(), pairs.end());
+    for (unsigned i = 0; i < n; ++i)
+    {
+        mIndices[i] = pairs[i].first;
+        mData[i] = pairs[i].second;
     }
-    dataIndex += countLowerBits(mIndexBitFlags[i / 64], i % 64);
-    mData.insert(mData.begin() + dataIndex, v);
-    mIndexBitFlags[i / 64] |= (1ull << (i % 64));
 }
 
 Vector SparseVector::getDense() const
@@ -109,6 +144,12 @@ unsigned SparseVector::nElements() const
     return mData.size();
 }
 
+// the data is fixed once loaded, so each column always takes the same path
+bool SparseVector::preferIndices() const
+{
+    return mData.size() < GAPS_SPARSE_INDEX_RATIO * mIndexBitFlags.size();
+}
+
 Archive& operator<<(Archive &ar, const SparseVector &vec)
 {
     ar << vec.mSize;
@@ -123,16 +164,27 @@ Archive& operator<<(Archive &ar, const SparseVector &vec)
     return ar;
 }
 
+// the indices and the number of non-zeros are rebuilt from the bit flags, so
+// the vector can be read into regardless of what it held before
 Archive& operator>>(Archive &ar, SparseVector &vec)
 {
     unsigned sz = 0;
     ar >> sz;
     GAPS_ASSERT(sz == vec.mSize);
 
+    vec.mIndices.clear();
     for (unsigned i = 0; i < vec.mIndexBitFlags.size(); ++i)
     {
         ar >> vec.mIndexBitFlags[i];
+        uint64_t flags = vec.mIndexBitFlags[i];
+        while (flags != 0u)
+        {
+            unsigned ndx = __builtin_ffsll(flags) - 1;
+            vec.mIndices.push_back(64 * i + ndx);
+            flags ^= 1ull << ndx;
+        }
     }
+    vec.mData.resize(vec.mIndices.size());
     for (unsigned i = 0; i < vec.mData.size(); ++i)
     {
         ar >> vec.mData[i];
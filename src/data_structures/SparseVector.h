@@ -4,6 +4,11 @@
 #include <stdint.h>
 #include <vector>
 
+// walking the sorted indices of the non-zeros is faster than walking the bit
+// flags when there are fewer than GAPS_SPARSE_INDEX_RATIO non-zeros per word
+// of bit flags, i.e. below roughly 3% density
+#define GAPS_SPARSE_INDEX_RATIO 2
+
 class Archive;
 class Vector;
 class SparseMatrix;
@@ -18,6 +23,8 @@ public:
     Vector getDense() const;
     const std::vector<float>& getData() const { return mData; }
     const std::vector<uint64_t>& getBitFlags() const { return mIndexBitFlags; }
+    const std::vector<unsigned>& getIndices() const { return mIndices; }
+    bool preferIndices() const;
     float at(unsigned n) const;
     float getIthElement(unsigned n) const;
     unsigned nElements() const;
@@ -26,11 +33,14 @@ public:
 private:
     template <unsigned N>
     friend class SparseIterator;
-    friend class SparseMatrix; // for inserting values
+    friend class SparseMatrix; // for filling in values
     unsigned mSize;
     std::vector<uint64_t> mIndexBitFlags;
+    std::vector<unsigned> mIndices; // sorted, same order as the data
     std::vector<float> mData;
-    void insert(unsigned i, float v);
+    void shrinkToFit();
+    void append(unsigned i, float v);
+    void sortIndices();
 };
 
 #endif // __COGAPS_SPARSE_VECTOR_H__
\ No newline at end of file
@@ -3,15 +3,14 @@
 #include "../utils/Archive.h"
 #include "../utils/GapsAssert.h"
 
-#define SIMD_PAD(x) (gaps::simd::Index::increment() + \
-    gaps::simd::Index::increment() * ((x) / gaps::simd::Index::increment())) 
+#define SIMD_PAD(x) (SIMD_PAD_WIDTH + SIMD_PAD_WIDTH * ((x) / SIMD_PAD_WIDTH))
 
 Vector::Vector(unsigned sz)
     :
 mData(SIMD_PAD(sz), 0.f),
 mSize(sz)
 {
-    GAPS_ASSERT((mData.size() % gaps::simd::Index::increment()) == 0);
+    GAPS_ASSERT((mData.size() % SIMD_PAD_WIDTH) == 0);
 }
 
 Vector::Vector(const std::vector<float> &v)
@@ -19,7 +18,7 @@ Vector::Vector(const std::vector<float> &v)
 mData(SIMD_PAD(v.size()), 0.f),
 mSize(v.size())
 {
-    GAPS_ASSERT((mData.size() % gaps::simd::Index::increment()) == 0);
+    GAPS_ASSERT((mData.size() % SIMD_PAD_WIDTH) == 0);
     for (unsigned i = 0; i < mSize; ++i)
     {
         mData[i] = v[i];
@@ -1,163 +1,225 @@
 #include "CharacterDelimitedParser.h"
+#include "NumberParser.h"
 #include "../utils/GapsAssert.h"
+#include "../utils/GapsPrint.h"
 
-#include <fstream>
-#include <iostream>
+#include <cstring>
 #include <sstream>
 
-static const std::string trimChars = " \r\n\"";
-
-static std::string ltrim(const std::string &s)
+static bool isTrimChar(char c)
 {
-    std::size_t start = s.find_first_not_of(trimChars);
-    return (start == std::string::npos) ? "" : s.substr(start);
+    return c == ' ' || c == '\r' || c == '\n' || c == '"';
 }
 
-static std::string rtrim(const std::string &s)
+static std::string trim(const char *begin, const char *end)
 {
-    std::size_t end = s.find_last_not_of(trimChars);
-    return (end == std::string::npos) ? "" : s.substr(0, end + 1);
+    while (begin < end && isTrimChar(*begin))
+    {
+        ++begin;
+    }
+    while (end > begin && isTrimChar(*(end - 1)))
+    {
+        --end;
+    }
+    return std::string(begin, end);
 }
 
-static std::string trim(const std::string &s)
+// end of the field or line starting at p
+static const char* find(const char *p, const char *end, char c)
 {
-    return rtrim(ltrim(s));
+    const char *pos = static_cast<const char*>(std::memchr(p, c, end - p));
+    return pos == NULL ? end : pos;
 }
 
-static std::string trimNewline(const std::string &s)
+static const char* nextLine(const char *p, const char *end)
 {
-    std::size_t pos;
-    if ((pos = s.find('\n')) == std::string::npos)
-    {
-        return s;
-    }
-    return s.substr(0, pos);
+    const char *eol = find(p, end, '\n');
+    return eol == end ? end : eol + 1;
 }
 
-static std::vector<std::string> split(const std::string &s, char delimiter)
+static bool isBlank(const char *p, const char *end)
 {
-    std::vector<std::string> tokens;
-    std::string temp;
-    std::stringstream ss(s);
-    while (std::getline(ss, temp, delimiter))
+    while (p < end && (*p == ' ' || *p == '\r'))
     {
-        tokens.push_back(trim(temp));
+        ++p;
     }
-    return tokens;    
+    return p == end;
 }
 
-void CharacterDelimitedParser::checkFileState() const
+// the value must take up the whole field apart from spaces and quotes
+static bool parseValue(const char *begin, const char *end, float *value)
 {
-    if (mFile.eof() || mFile.fail())
+    while (begin < end && isTrimChar(*begin))
     {
-        GAPS_ERROR("Invalid character delimited file");
+        ++begin;
+    }
+    while (end > begin && isTrimChar(*(end - 1)))
+    {
+        --end;
     }
+    return gaps::parseFloat(begin, end, value) == end && begin != end;
 }
 
-// read through whole file once, store row/col names and dimensions
+// The file is mapped into memory and the start of each line is recorded, so
+// the lines can be parsed in any order. Nothing is copied out of the file
+// until the values are parsed.
 CharacterDelimitedParser::CharacterDelimitedParser(const std::string &path, char delimiter, bool gctFormat)
     :
-mNumRows(0), mNumCols(0), mCurrentRow(0), mCurrentCol(0), mRowNamesPresent(false),
-mDelimiter(delimiter), mGctFormat(gctFormat)
+mFile(path), mNumRows(0), mNumCols(0), mCurrentRow(0), mCurrentCol(0),
+mNumSkippedFields(0), mRowNamesPresent(false), mDelimiter(delimiter),
+mGctFormat(gctFormat)
 {
-    // read first entry
-    mFile.open(path.c_str());
-    std::string line;
-
-    // if stored in gct format, read the second line with the dimensions
+    unsigned gctRows = 0;
     if (mGctFormat)
     {
-        std::getline(mFile, line);
-        std::getline(mFile, line);
-        checkFileState();
-        std::stringstream ss(line);
-        ss >> mNumRows >> mNumCols;
+        // the second line has the dimensions, the third has the column names
+        const char *dims = nextLine(mFile.begin(), mFile.end());
+        std::stringstream ss(trim(dims, find(dims, mFile.end(), '\n')));
+        ss >> gctRows >> mNumCols;
+        if (ss.fail())
+        {
+            GAPS_ERROR("Invalid character delimited file");
+        }
+        mNumSkippedFields = 2; // name and description
+        indexLines(nextLine(nextLine(dims, mFile.end()), mFile.end()));
+    }
+    else
+    {
+        indexLines(parseHeader());
     }
-    else // other formats need to walk the whole file to get the info
+
+    mNumRows = mLineStarts.size() - 1;
+    if (mNumCols == 0 || mNumRows == 0 || (mGctFormat && mNumRows != gctRows))
     {
-        std::getline(mFile, line, mDelimiter);
-        checkFileState();    
+        GAPS_ERROR("Invalid character delimited file");
+    }
+    if (!parseLine(0, &mCurrentLine))
+    {
+        GAPS_ERROR("Invalid entry found in input data, row " << 1);
+    }
+}
 
-        // check if row names are given, if not count this first read as a column
-        mRowNamesPresent = trim(line).empty();
-        if (!mRowNamesPresent)
-        {
-            ++mNumCols;
-            mColNames.push_back(trim(trimNewline(line)));
-        }
+CharacterDelimitedParser::~CharacterDelimitedParser() {}
+
+// check if row names are given, if not the first field is a column name
+const char* CharacterDelimitedParser::parseHeader()
+{
+    const char *eol = find(mFile.begin(), mFile.end(), '\n');
+    const char *p = mFile.begin();
+    while (p < eol)
+    {
+        const char *fieldEnd = find(p, eol, mDelimiter);
+        mColNames.push_back(trim(p, fieldEnd));
+        p = fieldEnd + 1;
+    }
+    if (!mColNames.empty() && mColNames[0].empty())
+    {
+        mRowNamesPresent = true;
+        mNumSkippedFields = 1;
+        mColNames.erase(mColNames.begin());
+    }
+    mNumCols = mColNames.size();
+    return eol == mFile.end() ? eol : eol + 1;
+}
 
-        // find number of columns and record column names
-        std::size_t pos;
-        do
+// record the start of every line that isn't blank, then group the lines into
+// blocks of roughly GAPS_PARSE_BLOCK_SIZE bytes
+void CharacterDelimitedParser::indexLines(const char *dataStart)
+{
+    const char *p = dataStart;
+    while (p < mFile.end())
+    {
+        const char *eol = find(p, mFile.end(), '\n');
+        if (!isBlank(p, eol))
         {
-            std::getline(mFile, line, mDelimiter);
-            checkFileState();
-            ++mNumCols;
-            mColNames.push_back(trim(trimNewline(line)));
+            mLineStarts.push_back(p - mFile.begin());
         }
-        while ((pos = line.find('\n')) == std::string::npos);
+        p = eol + 1;
+    }
+    mLineStarts.push_back(mFile.size());
 
-        // find number of rows
-        while (std::getline(mFile, line))
+    unsigned nLines = mLineStarts.size() - 1;
+    std::size_t blockStart = 0;
+    for (unsigned i = 0; i < nLines; ++i)
+    {
+        if (i == 0 || mLineStarts[i] - blockStart >= GAPS_PARSE_BLOCK_SIZE)
         {
-            ++mNumRows;
+            mBlockStarts.push_back(i);
+            blockStart = mLineStarts[i];
         }
     }
+    mBlockStarts.push_back(nLines);
+}
 
-    // reset file stream to beginning
-    mFile.clear();
-    mFile.seekg(0, std::ios::beg);
-    std::getline(mFile, line); // get rid of first line (column names for csv/tsv)
-    if (mGctFormat)
+// returns false if any value couldn't be parsed or the number of values is
+// wrong, this is called from multiple threads so it can't stop by itself
+bool CharacterDelimitedParser::parseLine(unsigned row,
+std::vector<MatrixElement> *elements) const
+{
+    elements->clear();
+    const char *p = mFile.begin() + mLineStarts[row];
+    const char *eol = find(p, mFile.begin() + mLineStarts[row + 1], '\n');
+    for (unsigned i = 0; i < mNumSkippedFields; ++i)
+    {
+        p = find(p, eol, mDelimiter) + 1;
+    }
+    for (unsigned j = 0; j < mNumCols; ++j)
     {
-        std::getline(mFile, line); // get rid of the file dimensions
-        std::getline(mFile, line); // get rid of the column names
+        if (p > eol)
+        {
+            return false;
+        }
+        const char *fieldEnd = find(p, eol, mDelimiter);
+        float value = 0.f;
+        if (!parseValue(p, fieldEnd, &value))
+        {
+            return false;
+        }
+        elements->push_back(MatrixElement(row, j, value));
+        p = fieldEnd + 1;
     }
-    parseNextLine();
+    return p > eol;
 }
 
-CharacterDelimitedParser::~CharacterDelimitedParser()
+bool CharacterDelimitedParser::hasNext()
 {
-    mFile.close();
+    return mCurrentCol < mCurrentLine.size() || mCurrentRow + 1 < mNumRows;
 }
 
-bool CharacterDelimitedParser::hasNext()
+MatrixElement CharacterDelimitedParser::getNext()
 {
-    if (mCurrentCol < mCurrentLine.size())
+    if (mCurrentCol == mCurrentLine.size())
     {
-        return true;
+        ++mCurrentRow;
+        mCurrentCol = 0;
+        if (!parseLine(mCurrentRow, &mCurrentLine))
+        {
+            GAPS_ERROR("Invalid entry found in input data, row " << mCurrentRow + 1);
+        }
     }
-    mFile >> std::ws;
-    return mFile.peek() != EOF;
+    return mCurrentLine[mCurrentCol++];
 }
 
-void CharacterDelimitedParser::parseNextLine()
+unsigned CharacterDelimitedParser::nBlocks() const
 {
-    std::string fullLine;
-    std::getline(mFile, fullLine);
-    mCurrentLine = split(fullLine, mDelimiter);
-    if (mRowNamesPresent)
-    {
-        mCurrentLine.erase(mCurrentLine.begin());
-    }
-    if (mGctFormat)
-    {
-        mCurrentLine.erase(mCurrentLine.begin(), mCurrentLine.begin() + 2);
-    }
+    return mBlockStarts.size() - 1;
 }
 
-MatrixElement CharacterDelimitedParser::getNext()
+bool CharacterDelimitedParser::getBlock(unsigned n,
+std::vector<MatrixElement> *elements) const
 {
-    if (mCurrentCol < mCurrentLine.size())
+    elements->clear();
+    std::vector<MatrixElement> line;
+    line.reserve(mNumCols);
+    for (unsigned i = mBlockStarts[n]; i < mBlockStarts[n + 1]; ++i)
     {
-        unsigned colIndex = mCurrentCol;
-        ++mCurrentCol;
-        return MatrixElement(mCurrentRow, colIndex, mCurrentLine[colIndex]);
+        if (!parseLine(i, &line))
+        {
+            return false;
+        }
+        elements->insert(elements->end(), line.begin(), line.end());
     }
-    parseNextLine();
-    ++mCurrentRow;
-    mCurrentCol = 0;
-    return getNext();
+    return true;
 }
 
 unsigned CharacterDelimitedParser::nRow() const
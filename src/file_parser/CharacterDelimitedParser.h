@@ -2,13 +2,13 @@
 #define __COGAPS_CHARACTER_DELIMITED_PARSER_H__
 
 #include "FileParser.h"
+#include "MappedFile.h"
+#include "MatrixElement.h"
 
-#include <fstream>
+#include <cstddef>
 #include <string>
 #include <vector>
 
-struct MatrixElement;
-
 class CharacterDelimitedParser : public AbstractFileParser
 {
 public:
@@ -20,23 +20,29 @@ public:
     unsigned nCol() const;
     bool hasNext();
     MatrixElement getNext();
+    unsigned nBlocks() const;
+    bool getBlock(unsigned n, std::vector<MatrixElement> *elements) const;
 private:
     CharacterDelimitedParser(const CharacterDelimitedParser &p); // don't allow copies
     CharacterDelimitedParser& operator=(const CharacterDelimitedParser &p); // don't allow copies
-    void parseNextLine();
-    void checkFileState() const;
+    const char* parseHeader();
+    void indexLines(const char *dataStart);
+    bool parseLine(unsigned row, std::vector<MatrixElement> *elements) const;
 
-    std::ifstream mFile;
+    MappedFile mFile;
     std::vector<std::string> mRowNames;
     std::vector<std::string> mColNames;
-    std::vector<std::string> mCurrentLine;
+    std::vector<std::size_t> mLineStarts; // offset of each row, plus the end of the file
+    std::vector<unsigned> mBlockStarts; // first row of each block, plus the number of rows
+    std::vector<MatrixElement> mCurrentLine;
     unsigned mNumRows;
     unsigned mNumCols;
     unsigned mCurrentRow;
     unsigned mCurrentCol;
+    unsigned mNumSkippedFields; // row names and gct descriptions
     bool mRowNamesPresent;
     char mDelimiter;
     bool mGctFormat;
 };
 
-#endif // __COGAPS_CHARACTER_DELIMITED_PARSER_H__
\ No newline at end of file
+#endif // __COGAPS_CHARACTER_DELIMITED_PARSER_H__
@@ -30,6 +30,22 @@ std::vector<std::string> AbstractFileParser::colNames() const
     return std::vector<std::string>();
 }
 
+// Parsers that can split the file into independent blocks return the number
+// of blocks here, getBlock can then be called from multiple threads at once.
+// It returns false if the block has an invalid entry, since stopping from
+// inside a parallel region isn't safe. The other parsers only support
+// reading one element at a time.
+unsigned AbstractFileParser::nBlocks() const
+{
+    return 0;
+}
+
+bool AbstractFileParser::getBlock(unsigned n, std::vector<MatrixElement> *elements) const // NOLINT
+{
+    GAPS_ERROR("this file type can't be read in blocks");
+    return false;
+}
+
 FileParser::FileParser(const std::string &path)
 {
     mParser = AbstractFileParser::create(path);
@@ -70,13 +86,28 @@ MatrixElement FileParser::getNext()
     return mParser->getNext();
 }
 
+unsigned FileParser::nBlocks() const
+{
+    return mParser->nBlocks();
+}
+
+bool FileParser::getBlock(unsigned n, std::vector<MatrixElement> *elements) const
+{
+    return mParser->getBlock(n, elements);
+}
+
+// only mtx files can be gzip compressed, the type is given by the extension
+// before .gz
 GapsFileType FileParser::fileType(const std::string &path)
 {
-    std::size_t pos = path.find_last_of('.');
-    std::string ext = path.substr(pos);
+    std::string name = isGzipped(path) ? path.substr(0, path.size() - 3) : path;
+    std::size_t pos = name.find_last_of('.');
+    if (pos == std::string::npos) { return GAPS_INVALID_FILE_TYPE; }
+    std::string ext = name.substr(pos);
 
     if (ext.find('/') != std::string::npos) { return GAPS_INVALID_FILE_TYPE; }
     if (ext == ".mtx")  { return GAPS_MTX; }
+    if (isGzipped(path)) { return GAPS_INVALID_FILE_TYPE; }
     if (ext == ".csv")  { return GAPS_CSV; }
     if (ext == ".tsv")  { return GAPS_TSV; }
     if (ext == ".gct")  { return GAPS_GCT; }
@@ -84,3 +115,8 @@ GapsFileType FileParser::fileType(const std::string &path)
     return GAPS_INVALID_FILE_TYPE;
 }
 
+bool FileParser::isGzipped(const std::string &path)
+{
+    return path.size() > 3 && path.compare(path.size() - 3, 3, ".gz") == 0;
+}
+
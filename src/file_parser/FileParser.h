@@ -7,6 +7,9 @@
 #include <fstream>
 #include <vector>
 
+// number of bytes of the file in each block that is parsed independently
+#define GAPS_PARSE_BLOCK_SIZE (1 << 20)
+
 enum GapsFileType
 {
     GAPS_MTX,
@@ -29,6 +32,8 @@ public:
     virtual unsigned nCol() const = 0;
     virtual bool hasNext() = 0;
     virtual MatrixElement getNext() = 0;
+    virtual unsigned nBlocks() const;
+    virtual bool getBlock(unsigned n, std::vector<MatrixElement> *elements) const;
 private:
     AbstractFileParser(const AbstractFileParser &p); // don't allow copies
     AbstractFileParser& operator=(const AbstractFileParser &p); // don't allow copies
@@ -46,7 +51,10 @@ public:
     unsigned nCol() const;
     bool hasNext();
     MatrixElement getNext();
+    unsigned nBlocks() const;
+    bool getBlock(unsigned n, std::vector<MatrixElement> *elements) const;
     static GapsFileType fileType(const std::string &path);
+    static bool isGzipped(const std::string &path);
     template <class MatrixType>
     static void writeToCsv(const std::string &path, const MatrixType &mat);
 private:
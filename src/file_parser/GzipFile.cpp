@@ -0,0 +1,120 @@
+#include "GzipFile.h"
+#include "../utils/GapsAssert.h"
+
+#include <cstring>
+
+#ifdef __GAPS_ZLIB__
+#include <zlib.h>
+#endif
+
+// number of bytes inflated at a time
+#define GAPS_GZIP_CHUNK_SIZE (1 << 20)
+
+#ifdef __GAPS_ZLIB__
+
+GzipFile::GzipFile(const std::string &path)
+    :
+mFile(gzopen(path.c_str(), "rb")), mBuffer(GAPS_GZIP_CHUNK_SIZE), mPos(0),
+mEnd(0), mError(false)
+{
+    if (mFile == NULL)
+    {
+        GAPS_ERROR("could not open file: " << path);
+    }
+    gzbuffer(mFile, GAPS_GZIP_CHUNK_SIZE);
+}
+
+GzipFile::~GzipFile()
+{
+    gzclose(mFile);
+}
+
+// returns false at the end of the file or if it is corrupted
+bool GzipFile::fill()
+{
+    int nBytes = gzread(mFile, &mBuffer[0], mBuffer.size());
+    mError = mError || nBytes < 0;
+    mPos = 0;
+    mEnd = nBytes > 0 ? nBytes : 0;
+    return nBytes > 0;
+}
+
+#else
+
+GzipFile::GzipFile(const std::string &path)
+    : mFile(NULL), mPos(0), mEnd(0), mError(true)
+{
+    GAPS_ERROR("CoGAPS was built without zlib, can't read " << path);
+}
+
+GzipFile::~GzipFile() {}
+
+bool GzipFile::fill()
+{
+    return false;
+}
+
+#endif
+
+// read a single line without the newline, returns false if the end of the
+// file has already been reached
+bool GzipFile::getLine(std::string *line)
+{
+    line->clear();
+    bool found = false;
+    while (mPos < mEnd || fill())
+    {
+        found = true;
+        const char *begin = &mBuffer[mPos];
+        const char *eol = static_cast<const char*>(std::memchr(begin, '\n',
+            mEnd - mPos));
+        if (eol != NULL)
+        {
+            line->append(begin, eol);
+            mPos += eol - begin + 1;
+            return true;
+        }
+        line->append(begin, mEnd - mPos);
+        mPos = mEnd;
+    }
+    return found && !mError;
+}
+
+// append the next n lines, including the newlines, fewer lines are read if
+// the file ends first - returns false if the file is corrupted
+bool GzipFile::getLines(unsigned n, std::string *text)
+{
+    unsigned count = 0;
+    while (count < n && (mPos < mEnd || fill()))
+    {
+        const char *begin = &mBuffer[mPos];
+        const char *end = begin + (mEnd - mPos);
+        const char *p = begin;
+        while (count < n)
+        {
+            const char *eol = static_cast<const char*>(std::memchr(p, '\n',
+                end - p));
+            if (eol == NULL)
+            {
+                p = end;
+                break;
+            }
+            p = eol + 1;
+            ++count;
+        }
+        text->append(begin, p);
+        mPos += p - begin;
+    }
+    return !mError;
+}
+
+// append everything that hasn't been read yet
+bool GzipFile::getRemaining(std::string *text)
+{
+    while (mPos < mEnd || fill())
+    {
+        text->append(&mBuffer[mPos], mEnd - mPos);
+        mPos = mEnd;
+    }
+    return !mError;
+}
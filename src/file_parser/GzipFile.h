@@ -0,0 +1,33 @@
+#ifndef __COGAPS_GZIP_FILE_H__
+#define __COGAPS_GZIP_FILE_H__
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+struct gzFile_s; // zlib handle, zlib.h is only needed in the source file
+
+// sequential reader for gzip compressed files, the file is inflated in large
+// chunks and handed out a number of whole lines at a time so that the text
+// can be parsed elsewhere
+class GzipFile
+{
+public:
+    explicit GzipFile(const std::string &path);
+    ~GzipFile();
+    bool getLine(std::string *line);
+    bool getLines(unsigned n, std::string *text);
+    bool getRemaining(std::string *text);
+private:
+    GzipFile(const GzipFile &f); // = delete (no c++11)
+    GzipFile& operator=(const GzipFile &f); // = delete (no c++11)
+    bool fill();
+
+    gzFile_s *mFile;
+    std::vector<char> mBuffer;
+    std::size_t mPos;
+    std::size_t mEnd;
+    bool mError;
+};
+
+#endif // __COGAPS_GZIP_FILE_H__
@@ -0,0 +1,79 @@
+#include "MappedFile.h"
+#include "../utils/GapsAssert.h"
+
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string &path)
+    : mData(NULL), mSize(0), mMapped(false)
+{
+#ifndef _WIN32
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd != -1 && fstat(fd, &info) == 0 && info.st_size > 0)
+    {
+        void *addr = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED)
+        {
+            madvise(addr, info.st_size, MADV_SEQUENTIAL);
+            mData = static_cast<const char*>(addr);
+            mSize = info.st_size;
+            mMapped = true;
+        }
+    }
+    if (fd != -1)
+    {
+        close(fd); // the mapping stays valid
+    }
+    if (mMapped)
+    {
+        return;
+    }
+#endif
+
+    std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+    if (!file.is_open())
+    {
+        GAPS_ERROR("could not open file: " << path);
+    }
+    file.seekg(0, std::ios::end);
+    mBuffer.resize(static_cast<std::size_t>(file.tellg()));
+    file.seekg(0, std::ios::beg);
+    if (!mBuffer.empty())
+    {
+        file.read(&mBuffer[0], mBuffer.size());
+        mData = &mBuffer[0];
+    }
+    mSize = mBuffer.size();
+}
+
+MappedFile::~MappedFile()
+{
+#ifndef _WIN32
+    if (mMapped)
+    {
+        munmap(const_cast<char*>(mData), mSize);
+    }
+#endif
+}
+
+const char* MappedFile::begin() const
+{
+    return mData;
+}
+
+const char* MappedFile::end() const
+{
+    return mData + mSize;
+}
+
+std::size_t MappedFile::size() const
+{
+    return mSize;
+}
@@ -0,0 +1,29 @@
+#ifndef __COGAPS_MAPPED_FILE_H__
+#define __COGAPS_MAPPED_FILE_H__
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// read only view of a whole file, the file is memory mapped where possible so
+// that it can be parsed from multiple threads without being copied, on other
+// platforms it is read into memory
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string &path);
+    ~MappedFile();
+    const char* begin() const;
+    const char* end() const;
+    std::size_t size() const;
+private:
+    MappedFile(const MappedFile &f); // = delete (no c++11)
+    MappedFile& operator=(const MappedFile &f); // = delete (no c++11)
+
+    const char *mData;
+    std::size_t mSize;
+    std::vector<char> mBuffer; // only used if the file can't be mapped
+    bool mMapped;
+};
+
+#endif // __COGAPS_MAPPED_FILE_H__
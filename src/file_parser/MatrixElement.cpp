@@ -3,6 +3,8 @@
 #include "../utils/GapsAssert.h"
 #include "../utils/GapsPrint.h"
 
+#include <algorithm>
+#include <iterator>
 #include <sstream>
 #include <string>
 
@@ -45,6 +47,41 @@ static float processValue(const std::string &s)
     }
 }
 
+MatrixElement::MatrixElement(unsigned r, unsigned c, float v)
+    : row(r), col(c), value(v)
+{}
+
 MatrixElement::MatrixElement(unsigned r, unsigned c, const std::string &s) // NOLINT
     : row(r), col(c), value(processValue(s))
-{}
\ No newline at end of file
+{}
+
+// find the position of this element in a matrix read from the file with the
+// given orientation and subset (R indices, sorted), returns false if it is not
+// part of the subset
+bool MatrixElement::position(bool genesInCols, bool subsetGenes,
+const std::vector<unsigned> &indices, unsigned *r, unsigned *c) const
+{
+    if (indices.empty())
+    {
+        *r = genesInCols ? col : row;
+        *c = genesInCols ? row : col;
+        return true;
+    }
+
+    unsigned searchIndex = 1 + ((subsetGenes != genesInCols) ? row : col);
+    std::vector<unsigned>::const_iterator pos =
+        std::lower_bound(indices.begin(), indices.end(), searchIndex);
+
+    // this index is included in the subset
+    if (pos != indices.end() && *pos == searchIndex)
+    {
+        *r = subsetGenes
+            ? std::distance(indices.begin(), pos)
+            : genesInCols ? col : row;
+        *c = !subsetGenes
+            ? std::distance(indices.begin(), pos)
+            : genesInCols ? row : col;
+        return true;
+    }
+    return false;
+}
\ No newline at end of file
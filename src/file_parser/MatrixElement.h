@@ -2,11 +2,14 @@
 #define __COGAPS_MATRIX_ELEMENT_H__
 
 #include <string>
+#include <vector>
 
 struct MatrixElement
 {
     MatrixElement(unsigned r, unsigned c, float v);
     MatrixElement(unsigned r, unsigned c, const std::string &s);
+    bool position(bool genesInCols, bool subsetGenes,
+        const std::vector<unsigned> &indices, unsigned *r, unsigned *c) const;
 
     unsigned row;
     unsigned col;
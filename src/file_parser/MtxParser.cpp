@@ -1,29 +1,204 @@
+#include "GzipFile.h"
+#include "MappedFile.h"
 #include "MatrixElement.h"
 #include "MtxParser.h"
+#include "NumberParser.h"
 
 #include "../utils/GapsAssert.h"
 
+#include <algorithm>
+#include <cctype>
+#include <cstring>
 #include <sstream>
 
-MtxParser::MtxParser(const std::string &path) : mNumRows(0), mNumCols(0)
+static const char* find(const char *p, const char *end, char c)
 {
-    mFile.open(path.c_str());
+    const char *pos = static_cast<const char*>(std::memchr(p, c, end - p));
+    return pos == NULL ? end : pos;
+}
+
+static const char* skipBlanks(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+    {
+        ++p;
+    }
+    return p;
+}
+
+static std::string toLower(std::string s)
+{
+    std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+    return s;
+}
 
-    // skip over comments
-    std::string line = "%";
-    while (line.find('%') != std::string::npos)
+// only the header is read here, the entries are read in blocks
+MtxParser::MtxParser(const std::string &path)
+    :
+mFile(NULL), mGzipFile(NULL), mNumInflatedBlocks(0), mHeaderEnd(0),
+mNumRows(0), mNumCols(0), mNumEntries(0), mNumBlocks(0),
+mCurrentBlockIndex(0), mCurrentElement(0), mPattern(false)
+{
+    if (FileParser::isGzipped(path))
+    {
+        mGzipFile = new GzipFile(path);
+    }
+    else
+    {
+        mFile = new MappedFile(path);
+    }
+
+    // the banner is optional, all other comments are skipped
+    std::string line;
+    bool firstLine = true;
+    bool foundSize = false;
+    while (!foundSize && getHeaderLine(&line))
+    {
+        std::size_t start = line.find_first_not_of(" \t\r");
+        if (start != std::string::npos && line[start] == '%')
+        {
+            if (firstLine)
+            {
+                parseBanner(line);
+            }
+        }
+        else if (start != std::string::npos)
+        {
+            parseSize(line);
+            foundSize = true;
+        }
+        firstLine = false;
+    }
+    if (!foundSize)
     {
-        std::getline(mFile, line);
-        checkFileState();
+        GAPS_ERROR("Invalid MTX file");
     }
 
-    std::stringstream ss(line); // this line contains dimensions
-    ss >> mNumRows >> mNumCols;
+    if (mFile != NULL)
+    {
+        indexBlocks();
+    }
+    else
+    {
+        mNumBlocks = mNumEntries / GAPS_GZIP_BLOCK_ENTRIES
+            + (mNumEntries % GAPS_GZIP_BLOCK_ENTRIES == 0 ? 0 : 1);
+    }
 }
 
 MtxParser::~MtxParser()
 {
-    mFile.close();
+    delete mFile;
+    delete mGzipFile;
+}
+
+bool MtxParser::getHeaderLine(std::string *line)
+{
+    if (mGzipFile != NULL)
+    {
+        return mGzipFile->getLine(line);
+    }
+    if (mHeaderEnd >= mFile->size())
+    {
+        return false;
+    }
+    const char *begin = mFile->begin() + mHeaderEnd;
+    const char *eol = find(begin, mFile->end(), '\n');
+    line->assign(begin, eol);
+    mHeaderEnd = (eol == mFile->end()) ? mFile->size() : eol + 1 - mFile->begin();
+    return true;
+}
+
+// %%MatrixMarket matrix coordinate [real|integer|pattern] general
+void MtxParser::parseBanner(const std::string &line)
+{
+    std::stringstream ss(toLower(line));
+    std::string banner, object, format, field, symmetry;
+    ss >> banner >> object >> format >> field >> symmetry;
+    if (banner != "%%matrixmarket")
+    {
+        return;
+    }
+    if (ss.fail() || object != "matrix" || format != "coordinate"
+    || symmetry != "general"
+    || (field != "real" && field != "integer" && field != "pattern"))
+    {
+        GAPS_ERROR("unsupported MTX format, only general coordinate matrices"
+            " with real, integer or pattern entries can be read: " << line);
+    }
+    mPattern = (field == "pattern");
+}
+
+void MtxParser::parseSize(const std::string &line)
+{
+    const char *p = line.data();
+    const char *end = p + line.size();
+    p = gaps::parseUnsigned(skipBlanks(p, end), end, &mNumRows);
+    p = p ? gaps::parseUnsigned(skipBlanks(p, end), end, &mNumCols) : NULL;
+    p = p ? gaps::parseUnsigned(skipBlanks(p, end), end, &mNumEntries) : NULL;
+    if (p == NULL || skipBlanks(p, end) != end)
+    {
+        GAPS_ERROR("Invalid MTX file");
+    }
+}
+
+// split the entries into blocks of roughly GAPS_PARSE_BLOCK_SIZE bytes that
+// start at the beginning of a line
+void MtxParser::indexBlocks()
+{
+    std::size_t size = mFile->size();
+    mBlockStarts.push_back(mHeaderEnd);
+    for (std::size_t offset = mHeaderEnd + GAPS_PARSE_BLOCK_SIZE; offset < size;
+    offset += GAPS_PARSE_BLOCK_SIZE)
+    {
+        const char *eol = find(mFile->begin() + offset, mFile->end(), '\n');
+        std::size_t start = (eol == mFile->end()) ? size : eol + 1 - mFile->begin();
+        if (start > mBlockStarts.back() && start < size)
+        {
+            mBlockStarts.push_back(start);
+        }
+    }
+    if (mHeaderEnd < size)
+    {
+        mBlockStarts.push_back(size);
+    }
+    mNumBlocks = mBlockStarts.size() - 1;
+}
+
+// "row col value" on each line, or just "row col" for pattern matrices,
+// returns false if any line is invalid or out of bounds
+bool MtxParser::parseEntries(const char *begin, const char *end,
+std::vector<MatrixElement> *elements) const
+{
+    const char *p = begin;
+    while (p < end)
+    {
+        p = skipBlanks(p, end);
+        if (p == end || *p == '\n')
+        {
+            p += (p == end) ? 0 : 1; // blank line
+            continue;
+        }
+        unsigned row = 0, col = 0;
+        float value = 1.f;
+        p = gaps::parseUnsigned(p, end, &row);
+        p = p ? gaps::parseUnsigned(skipBlanks(p, end), end, &col) : NULL;
+        if (p != NULL && !mPattern)
+        {
+            p = gaps::parseFloat(skipBlanks(p, end), end, &value);
+        }
+        if (p == NULL)
+        {
+            return false;
+        }
+        p = skipBlanks(p, end);
+        if ((p < end && *p != '\n') || row == 0 || col == 0 || row > mNumRows
+        || col > mNumCols)
+        {
+            return false;
+        }
+        elements->push_back(MatrixElement(row - 1, col - 1, value));
+    }
+    return true;
 }
 
 unsigned MtxParser::nRow() const
@@ -36,27 +211,66 @@ unsigned MtxParser::nCol() const
     return mNumCols;
 }
 
-void MtxParser::checkFileState() const
+bool MtxParser::hasNext()
 {
-    if (mFile.eof() || mFile.fail())
+    while (mCurrentElement == mCurrentBlock.size() && mCurrentBlockIndex < mNumBlocks)
     {
-        GAPS_ERROR("Invalid MTX file");
+        if (!getBlock(mCurrentBlockIndex++, &mCurrentBlock))
+        {
+            GAPS_ERROR("Invalid MTX file");
+        }
+        mCurrentElement = 0;
     }
+    return mCurrentElement < mCurrentBlock.size();
 }
 
-bool MtxParser::hasNext()
+MatrixElement MtxParser::getNext()
 {
-    mFile >> std::ws; // get rid of whitespace
-    return mFile.peek() != EOF;
+    hasNext(); // make sure the next block is loaded
+    GAPS_ASSERT(mCurrentElement < mCurrentBlock.size());
+    return mCurrentBlock[mCurrentElement++];
 }
 
-MatrixElement MtxParser::getNext()
+unsigned MtxParser::nBlocks() const
 {
-    unsigned row = 0;
-    unsigned col = 0;
-    std::string val;
-    mFile >> row;
-    mFile >> col;
-    mFile >> val;
-    return MatrixElement(row - 1, col - 1, val);
+    return mNumBlocks;
+}
+
+bool MtxParser::getBlock(unsigned n, std::vector<MatrixElement> *elements) const
+{
+    elements->clear();
+    if (mFile != NULL)
+    {
+        const char *begin = mFile->begin() + mBlockStarts[n];
+        const char *end = mFile->begin() + mBlockStarts[n + 1];
+        elements->reserve((end - begin) / 8); // rough guess of the line length
+        return parseEntries(begin, end, elements);
+    }
+
+    // the last block takes whatever is left in the file
+    std::string text;
+    bool valid = true;
+    #pragma omp critical(GapsInflateMtx)
+    {
+        while (valid && mNumInflatedBlocks <= n)
+        {
+            std::string &block(mInflatedBlocks[mNumInflatedBlocks]);
+            valid = (mNumInflatedBlocks + 1 == mNumBlocks)
+                ? mGzipFile->getRemaining(&block)
+                : mGzipFile->getLines(GAPS_GZIP_BLOCK_ENTRIES, &block);
+            ++mNumInflatedBlocks;
+        }
+        std::map<unsigned, std::string>::iterator it = mInflatedBlocks.find(n);
+        if (it != mInflatedBlocks.end())
+        {
+            text.swap(it->second);
+            mInflatedBlocks.erase(it);
+        }
+        else
+        {
+            valid = false; // each block can only be read once
+        }
+    }
+    elements->reserve(GAPS_GZIP_BLOCK_ENTRIES);
+    return valid && parseEntries(text.data(), text.data() + text.size(), elements);
 }
@@ -2,12 +2,23 @@
 #define __COGAPS_MTX_PARSER_H__
 
 #include "FileParser.h"
+#include "MatrixElement.h"
 
-#include <fstream>
+#include <cstddef>
+#include <map>
 #include <string>
+#include <vector>
 
-struct MatrixElement;
+class GzipFile;
+class MappedFile;
 
+// number of entries in each block of a gzip compressed file
+#define GAPS_GZIP_BLOCK_ENTRIES (1 << 16)
+
+// Uncompressed files are memory mapped and split into blocks of lines that
+// can be parsed in any order. Compressed files can only be inflated in order,
+// so each block is inflated under a lock when it is first needed and then
+// parsed in parallel with the inflation of the next blocks.
 class MtxParser : public AbstractFileParser
 {
 public:
@@ -17,14 +28,32 @@ public:
     unsigned nCol() const;
     bool hasNext();
     MatrixElement getNext();
+    unsigned nBlocks() const;
+    bool getBlock(unsigned n, std::vector<MatrixElement> *elements) const;
 private:
     MtxParser(const MtxParser &p); // don't allow copies
     MtxParser& operator=(const MtxParser &p); // don't allow copies
-    void checkFileState() const;
+    bool getHeaderLine(std::string *line);
+    void parseBanner(const std::string &line);
+    void parseSize(const std::string &line);
+    void indexBlocks();
+    bool parseEntries(const char *begin, const char *end,
+        std::vector<MatrixElement> *elements) const;
 
-    std::ifstream mFile;
+    MappedFile *mFile; // NULL if the file is compressed
+    GzipFile *mGzipFile; // NULL if the file is not compressed
+    std::vector<std::size_t> mBlockStarts; // offsets in the mapped file
+    mutable std::map<unsigned, std::string> mInflatedBlocks; // not parsed yet
+    mutable unsigned mNumInflatedBlocks;
+    std::vector<MatrixElement> mCurrentBlock;
+    std::size_t mHeaderEnd;
     unsigned mNumRows;
     unsigned mNumCols;
+    unsigned mNumEntries;
+    unsigned mNumBlocks;
+    unsigned mCurrentBlockIndex;
+    unsigned mCurrentElement;
+    bool mPattern; // only positions are given, every value is one
 };
 
-#endif // __COGAPS_MTX_PARSER_H__
\ No newline at end of file
+#endif // __COGAPS_MTX_PARSER_H__
@@ -0,0 +1,132 @@
+#include "NumberParser.h"
+
+#include <cmath>
+#include <cstddef>
+#include <stdint.h>
+
+// at most this many significant digits are accumulated, the rest only change
+// the exponent which is far beyond float precision anyway
+#define GAPS_MAX_DIGITS 19
+
+// powers of ten that are exactly representable as doubles
+static const double exactPowersOfTen[] =
+{
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+// The digits are accumulated in an integer and scaled once by an exact power
+// of ten, which rounds to the nearest double. Rounding that to a float gives
+// the correctly rounded value for everything except numbers that are within
+// one double ulp of halfway between two floats.
+const char* gaps::parseFloat(const char *begin, const char *end, float *value)
+{
+    const char *p = begin;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = (*p == '-');
+        ++p;
+    }
+
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    unsigned nDigits = 0;
+    bool foundDigit = false;
+    for (; p < end && isDigit(*p); ++p)
+    {
+        foundDigit = true;
+        if (nDigits < GAPS_MAX_DIGITS)
+        {
+            mantissa = 10 * mantissa + static_cast<unsigned>(*p - '0');
+            nDigits += (mantissa != 0) ? 1 : 0;
+        }
+        else
+        {
+            ++exponent;
+        }
+    }
+    if (p < end && *p == '.')
+    {
+        for (++p; p < end && isDigit(*p); ++p)
+        {
+            foundDigit = true;
+            if (nDigits < GAPS_MAX_DIGITS)
+            {
+                mantissa = 10 * mantissa + static_cast<unsigned>(*p - '0');
+                nDigits += (mantissa != 0) ? 1 : 0;
+                --exponent;
+            }
+        }
+    }
+    if (!foundDigit)
+    {
+        return NULL;
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        ++p;
+        bool negativeExp = false;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            negativeExp = (*p == '-');
+            ++p;
+        }
+        if (p == end || !isDigit(*p))
+        {
+            return NULL;
+        }
+        int exp = 0;
+        for (; p < end && isDigit(*p); ++p)
+        {
+            exp = (exp < 10000) ? 10 * exp + (*p - '0') : exp;
+        }
+        exponent += negativeExp ? -exp : exp;
+    }
+
+    double result = static_cast<double>(mantissa);
+    if (mantissa == 0)
+    {
+        result = 0.0;
+    }
+    else if (exponent >= 0 && exponent <= 22)
+    {
+        result *= exactPowersOfTen[exponent];
+    }
+    else if (exponent < 0 && exponent >= -22)
+    {
+        result /= exactPowersOfTen[-exponent];
+    }
+    else
+    {
+        result *= std::pow(10.0, exponent);
+    }
+    *value = static_cast<float>(negative ? -result : result);
+    return p;
+}
+
+const char* gaps::parseUnsigned(const char *begin, const char *end, unsigned *value)
+{
+    const char *p = begin;
+    uint64_t result = 0;
+    for (; p < end && isDigit(*p); ++p)
+    {
+        result = 10 * result + static_cast<unsigned>(*p - '0');
+        if (result > 0xFFFFFFFFull)
+        {
+            return NULL;
+        }
+    }
+    if (p == begin)
+    {
+        return NULL;
+    }
+    *value = static_cast<unsigned>(result);
+    return p;
+}
@@ -0,0 +1,14 @@
+#ifndef __COGAPS_NUMBER_PARSER_H__
+#define __COGAPS_NUMBER_PARSER_H__
+
+// Parse a number from the start of [begin, end) without copying it into a
+// string first, these return a pointer to the first character after the
+// number or NULL if there is no number at the start of the range
+
+namespace gaps
+{
+    const char* parseFloat(const char *begin, const char *end, float *value);
+    const char* parseUnsigned(const char *begin, const char *end, unsigned *value);
+} // namespace gaps
+
+#endif // __COGAPS_NUMBER_PARSER_H__
@@ -38,10 +38,18 @@ public:
         GapsRandomState *randState);
     unsigned nAtoms() const;
     float getAverageQueueLength() const;
+    std::vector<uint64_t> queueLengthHistogram() const;
+    std::vector<uint64_t> conflictHistogram() const;
     void update(unsigned nSteps, unsigned nThreads);
     friend Archive& operator<< <DataModel> (Archive &ar, const AsynchronousGibbsSampler &s);
     friend Archive& operator>> <DataModel> (Archive &ar, AsynchronousGibbsSampler &s);
 private:
+    void updateWithPersistentThreads(unsigned nSteps, unsigned nThreads);
+    void updateWithPipelinedQueue(unsigned nSteps, unsigned nThreads);
+    unsigned populateQueue(unsigned limit);
+    void beginQueue(bool recordLength);
+    void processProposal(const AtomicProposal &prop);
+    void finishQueue();
     void birth(const AtomicProposal &prop);
     void death(const AtomicProposal &prop);
     void move(const AtomicProposal &prop);
@@ -51,8 +59,11 @@ private:
 #endif
     ConcurrentAtomicDomain mDomain; // data structure providing access to atoms
     ProposalQueue mQueue; // creates queue of proposals that get evaluated by sampler
+    std::vector<uint64_t> mQueueLengthHistogram; // number of queues of each length
     float mAvgQueueLength;
     float mNumQueueSamples;
+    bool mPersistentThreads; // keep one team of threads alive for all queues
+    bool mPipelinedQueue; // populate the next queue while evaluating this one
 };
 
 //////////////////// AsynchronousGibbsSampler - templated functions ////////////////////////
@@ -67,10 +78,15 @@ DataModel(data, transpose, subsetRows, params, alpha, maxGibbsMass),
 mDomain(DataModel::nElements()),
 mQueue(DataModel::nElements(), DataModel::nPatterns(), randState),
 mAvgQueueLength(0),
-mNumQueueSamples(0)
+mNumQueueSamples(0),
+mPersistentThreads(params.persistentThreads),
+mPipelinedQueue(params.pipelinedQueue)
 {
     mQueue.setAlpha(alpha);
     mQueue.setLambda(DataModel::lambda());
+    // a pipelined queue is populated against the queue being evaluated, so
+    // it has to defer the proposals that conflict with it instead of stopping
+    mQueue.setSpeculative(params.speculativeQueue || params.pipelinedQueue);
 }
 
 template <class DataModel>
@@ -85,42 +101,229 @@ float AsynchronousGibbsSampler<DataModel>::getAverageQueueLength() const
     return mAvgQueueLength;
 }
 
+template <class DataModel>
+std::vector<uint64_t> AsynchronousGibbsSampler<DataModel>::queueLengthHistogram() const
+{
+    return mQueueLengthHistogram;
+}
+
+template <class DataModel>
+std::vector<uint64_t> AsynchronousGibbsSampler<DataModel>::conflictHistogram() const
+{
+    return mQueue.conflictHistogram();
+}
+
 template <class DataModel>
 void AsynchronousGibbsSampler<DataModel>::update(unsigned nSteps, unsigned nThreads)
 {
+    if (mPipelinedQueue)
+    {
+        updateWithPipelinedQueue(nSteps, nThreads);
+        return;
+    }
+
+    if (mPersistentThreads)
+    {
+        updateWithPersistentThreads(nSteps, nThreads);
+        return;
+    }
+
     unsigned n = 0;
     while (n < nSteps)
     {
-        // create the largest queue possible, without hitting any conflicts
-        mQueue.populate(mDomain, nSteps - n);
-        n += mQueue.nProcessed();
-        if (n < nSteps) // don't count last one since it might be truncated
-        {
-            mNumQueueSamples += 1.f; // record the size of the queue for diagnostics
-            mAvgQueueLength *= (mNumQueueSamples - 1.f) / mNumQueueSamples;
-            mAvgQueueLength += static_cast<float>(mQueue.size()) / mNumQueueSamples;
-        }
+        n += populateQueue(nSteps - n);
+        beginQueue(n < nSteps); // don't count last one since it might be truncated
+
         // process all proposed updates in parallel - the way the queue is 
         // populated ensures no race conditions will happen
         #pragma omp parallel for num_threads(nThreads)
         for (unsigned i = 0; i < mQueue.size(); ++i)
         {
-            switch (mQueue[i].type)
+            processProposal(mQueue[i]);
+        }
+        finishQueue();
+    }
+    GAPS_ASSERT(n == nSteps);
+    if (mDomain.cacheOverflowed())
+    {
+        GAPS_ERROR("more atoms were erased or moved than reserved for");
+    }
+    GAPS_ASSERT(mDomain.isSorted());
+    GAPS_ASSERT_MSG(maximumDrift() < 0.01f, "maximum drift: " << maximumDrift());
+}
+
+// Queues are often short, so the cost of starting a parallel region for every
+// queue can outweigh the work done in it. Here a single team of threads is
+// created for the whole update, one thread populates each queue while the
+// others wait at a barrier (spinning or sleeping according to OMP_WAIT_POLICY)
+// and then the whole team processes it. The same proposals are evaluated as
+// in update, so the results are identical.
+template <class DataModel>
+void AsynchronousGibbsSampler<DataModel>::updateWithPersistentThreads(unsigned nSteps,
+unsigned nThreads)
+{
+    unsigned n = 0;
+    bool done = false;
+    #pragma omp parallel num_threads(nThreads)
+    {
+        // done is only read between the barriers following the single
+        // region that writes it, so every thread sees the same value
+        while (true)
+        {
+            #pragma omp single
+            {
+                done = (n == nSteps);
+                if (!done)
+                {
+                    n += populateQueue(nSteps - n);
+                    beginQueue(n < nSteps);
+                }
+            }
+            if (done)
+            {
+                break;
+            }
+
+            #pragma omp for
+            for (unsigned i = 0; i < mQueue.size(); ++i)
+            {
+                processProposal(mQueue[i]);
+            }
+
+            #pragma omp single
+            {
+                finishQueue();
+            }
+        }
+    }
+    GAPS_ASSERT(n == nSteps);
+    if (mDomain.cacheOverflowed())
+    {
+        GAPS_ERROR("more atoms were erased or moved than reserved for");
+    }
+    GAPS_ASSERT(mDomain.isSorted());
+    GAPS_ASSERT_MSG(maximumDrift() < 0.01f, "maximum drift: " << maximumDrift());
+}
+
+// Here the next queue is populated while the current one is evaluated. One
+// thread populates against a frozen snapshot of the rows and atoms used by the
+// current queue, the rest of the team starts evaluating and the populating
+// thread joins in when it is done. Accepted moves and erased atoms are cached
+// and applied after the evaluation, so the domain doesn't change while the
+// next queue is populated. The queue is always speculative: a proposal that
+// touches the current queue, including one that picks an atom waiting to be
+// erased, conflicts with the snapshot and is deferred rather than ending the
+// queue. Which proposals are deferred only depends on the snapshot, so the
+// results depend on the seed but not on the number of threads, though they
+// differ from those of update.
+template <class DataModel>
+void AsynchronousGibbsSampler<DataModel>::updateWithPipelinedQueue(unsigned nSteps,
+unsigned nThreads)
+{
+    unsigned n = populateQueue(nSteps);
+    bool pending = true; // a populated queue is waiting to be evaluated
+    bool done = false;
+    #pragma omp parallel num_threads(nThreads)
+    {
+        // n, pending and done are only written inside single regions and
+        // only read after the barrier that follows the write
+        while (true)
+        {
+            #pragma omp single
+            {
+                done = !pending;
+                if (!done)
+                {
+                    beginQueue(n < nSteps);
+                    pending = false;
+                }
+            }
+            if (done)
+            {
+                break;
+            }
+
+            #pragma omp single nowait
+            {
+                if (n < nSteps)
+                {
+                    n += populateQueue(nSteps - n);
+                    pending = true;
+                }
+            }
+
+            #pragma omp for schedule(dynamic)
+            for (unsigned i = 0; i < mQueue.size(); ++i)
+            {
+                processProposal(mQueue[i]);
+            }
+
+            #pragma omp single
             {
-                case 'B': birth(mQueue[i]);    break;
-                case 'D': death(mQueue[i]);    break;
-                case 'M': move(mQueue[i]);     break;
-                case 'E': exchange(mQueue[i]); break;
+                finishQueue();
             }
         }
-        mQueue.clear();
-        mDomain.flushEraseCache();
     }
     GAPS_ASSERT(n == nSteps);
+    if (mDomain.cacheOverflowed())
+    {
+        GAPS_ERROR("more atoms were erased or moved than reserved for");
+    }
     GAPS_ASSERT(mDomain.isSorted());
     GAPS_ASSERT_MSG(maximumDrift() < 0.01f, "maximum drift: " << maximumDrift());
 }
 
+// create the largest queue possible without hitting any conflicts, returns
+// the number of steps this queue accounts for
+template <class DataModel>
+unsigned AsynchronousGibbsSampler<DataModel>::populateQueue(unsigned limit)
+{
+    mQueue.populate(mDomain, limit);
+    return mQueue.nProcessed();
+}
+
+// hand the populated queue off for evaluation
+template <class DataModel>
+void AsynchronousGibbsSampler<DataModel>::beginQueue(bool recordLength)
+{
+    mQueue.beginEvaluation();
+    if (recordLength)
+    {
+        mNumQueueSamples += 1.f; // record the size of the queue for diagnostics
+        mAvgQueueLength *= (mNumQueueSamples - 1.f) / mNumQueueSamples;
+        mAvgQueueLength += static_cast<float>(mQueue.size()) / mNumQueueSamples;
+        if (mQueue.size() >= mQueueLengthHistogram.size())
+        {
+            mQueueLengthHistogram.resize(mQueue.size() + 1, 0);
+        }
+        ++mQueueLengthHistogram[mQueue.size()];
+    }
+    // each proposal erases or moves at most one atom, so the size of the
+    // queue bounds the number of cached erases and moves
+    mDomain.reserveEraseCache(mQueue.size());
+    mDomain.reserveMoveCache(mQueue.size());
+}
+
+template <class DataModel>
+void AsynchronousGibbsSampler<DataModel>::processProposal(const AtomicProposal &prop)
+{
+    switch (prop.type)
+    {
+        case 'B': birth(prop);    break;
+        case 'D': death(prop);    break;
+        case 'M': move(prop);     break;
+        case 'E': exchange(prop); break;
+    }
+}
+
+template <class DataModel>
+void AsynchronousGibbsSampler<DataModel>::finishQueue()
+{
+    mDomain.flushMoveCache();
+    mDomain.flushEraseCache();
+    mQueue.endEvaluation();
+}
+
 // add an atom at a random position, calculate mass either with an
 // exponential distribution or with the gibbs mass distribution
 template <class DataModel>
@@ -188,7 +391,14 @@ void AsynchronousGibbsSampler<DataModel>::move(const AtomicProposal &prop)
         prop.atom1->mass());
     if (std::log(prop.rng.uniform()) < deltaLL)
     {
-        mDomain.move(prop.atom1, prop.pos);
+        if (mPipelinedQueue)
+        {
+            mDomain.cacheMove(prop.atom1, prop.pos);
+        }
+        else
+        {
+            mDomain.move(prop.atom1, prop.pos);
+        }
         DataModel::safelyChangeMatrix(prop.r1, prop.c1, -prop.atom1->mass());
         DataModel::changeMatrix(prop.r2, prop.c2, prop.atom1->mass());
         return;
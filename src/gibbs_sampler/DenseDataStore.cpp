@@ -0,0 +1,220 @@
+#include "DenseDataStore.h"
+#include "../math/MatrixMath.h"
+#include "../utils/GapsAssert.h"
+#include "../utils/GapsPrint.h"
+
+DenseDataStore::DenseDataStore(const Matrix &data, const GapsParameters &params,
+bool referenceInput)
+    :
+mInput(&data),
+mPView(NULL),
+mAView(NULL),
+mIndices(params.dataIndicesSubset),
+mTransposeData(params.transposeData),
+mSubsetGenes(params.subsetGenes),
+mReferenceInput(referenceInput),
+mNumThreads(params.maxThreads),
+mNumGenes(0),
+mNumSamples(0),
+mNonZeroMean(0.f),
+mMax(0.f),
+mSparsity(0.f),
+mLoaded(false),
+mRefCount(0)
+{}
+
+// a file is never referenced, the flag is only here to match the matrix version
+DenseDataStore::DenseDataStore(const std::string &path, const GapsParameters &params,
+bool referenceInput)
+    :
+mInput(NULL),
+mPath(path),
+mPView(NULL),
+mAView(NULL),
+mIndices(params.dataIndicesSubset),
+mTransposeData(params.transposeData),
+mSubsetGenes(params.subsetGenes),
+mReferenceInput(false),
+mNumThreads(params.maxThreads),
+mNumGenes(0),
+mNumSamples(0),
+mNonZeroMean(0.f),
+mMax(0.f),
+mSparsity(0.f),
+mLoaded(false),
+mRefCount(0)
+{}
+
+// the P model is constructed with the transpose flag of the parameters and
+// the A model with the opposite one
+bool DenseDataStore::isAModel(bool transpose) const
+{
+    return transpose != mTransposeData;
+}
+
+const Matrix& DenseDataStore::acquire(bool transpose)
+{
+    load();
+    if (isAModel(transpose))
+    {
+        if (mAView == NULL)
+        {
+            buildAView();
+        }
+        return *mAView;
+    }
+    if (mPView == NULL)
+    {
+        buildPView();
+    }
+    return *mPView;
+}
+
+void DenseDataStore::release(bool transpose)
+{
+    if (isAModel(transpose))
+    {
+        mOwnedAView = Matrix();
+        mAView = NULL;
+    }
+    else
+    {
+        mOwnedPView = Matrix();
+        mPView = NULL;
+    }
+}
+
+bool DenseDataStore::hasView(bool transpose) const
+{
+    return isAModel(transpose) ? mAView != NULL : mPView != NULL;
+}
+
+unsigned DenseDataStore::nRow(bool transpose)
+{
+    load();
+    return isAModel(transpose) ? mNumSamples : mNumGenes;
+}
+
+unsigned DenseDataStore::nCol(bool transpose)
+{
+    load();
+    return isAModel(transpose) ? mNumGenes : mNumSamples;
+}
+
+float DenseDataStore::nonZeroMean() const
+{
+    GAPS_ASSERT(mLoaded);
+    return mNonZeroMean;
+}
+
+float DenseDataStore::max() const
+{
+    GAPS_ASSERT(mLoaded);
+    return mMax;
+}
+
+float DenseDataStore::sparsity() const
+{
+    GAPS_ASSERT(mLoaded);
+    return mSparsity;
+}
+
+// no copy is needed if the input is already genes by samples
+void DenseDataStore::buildPView()
+{
+    if (mReferenceInput && !mTransposeData && mIndices.empty())
+    {
+        mPView = mInput;
+    }
+    else if (mAView != NULL)
+    {
+        mOwnedPView = Matrix(*mAView, true, false, std::vector<unsigned>(),
+            mNumThreads);
+        mPView = &mOwnedPView;
+    }
+    else
+    {
+        mOwnedPView = (mInput != NULL)
+            ? Matrix(*mInput, mTransposeData, mSubsetGenes, mIndices, mNumThreads)
+            : Matrix(mPath, mTransposeData, mSubsetGenes, mIndices, mNumThreads);
+        mPView = &mOwnedPView;
+    }
+}
+
+// when one view already exists the other one is its transpose, which is much
+// faster to build than reading the file again or subsetting the input again
+void DenseDataStore::buildAView()
+{
+    if (mReferenceInput && mTransposeData && mIndices.empty())
+    {
+        mAView = mInput;
+    }
+    else if (mPView != NULL)
+    {
+        mOwnedAView = Matrix(*mPView, true, false, std::vector<unsigned>(),
+            mNumThreads);
+        mAView = &mOwnedAView;
+    }
+    else
+    {
+        mOwnedAView = (mInput != NULL)
+            ? Matrix(*mInput, !mTransposeData, !mSubsetGenes, mIndices, mNumThreads)
+            : Matrix(mPath, !mTransposeData, !mSubsetGenes, mIndices, mNumThreads);
+        mAView = &mOwnedAView;
+    }
+}
+
+// The dimensions and statistics come from the P view no matter which model
+// uses the store first. The P model always needs the data while the A model
+// goes without it when A is fixed, so the view built here is never wasted.
+void DenseDataStore::load()
+{
+    if (mLoaded)
+    {
+        return;
+    }
+    mLoaded = true;
+    buildPView();
+    mNumGenes = mPView->nRow();
+    mNumSamples = mPView->nCol();
+    mNonZeroMean = gaps::nonZeroMean(*mPView);
+    mMax = gaps::max(*mPView);
+    mSparsity = gaps::sparsity(*mPView);
+    if (mMax > 50.f)
+    {
+        gaps_printf("\nWarning: Large values detected, is data log transformed?\n");
+    }
+}
+
+SharedDenseData::SharedDenseData(DenseDataStore *store) : mStore(store)
+{
+    GAPS_ASSERT(mStore != NULL);
+    ++mStore->mRefCount;
+}
+
+SharedDenseData::SharedDenseData(const SharedDenseData &other)
+    : mStore(other.mStore)
+{
+    ++mStore->mRefCount;
+}
+
+SharedDenseData& SharedDenseData::operator=(const SharedDenseData &other)
+{
+    ++other.mStore->mRefCount; // increment first in case of self assignment
+    decrement();
+    mStore = other.mStore;
+    return *this;
+}
+
+SharedDenseData::~SharedDenseData()
+{
+    decrement();
+}
+
+void SharedDenseData::decrement()
+{
+    if (--mStore->mRefCount == 0)
+    {
+        delete mStore;
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef __COGAPS_DENSE_DATA_STORE_H__
+#define __COGAPS_DENSE_DATA_STORE_H__
+
+#include "../GapsParameters.h"
+#include "../data_structures/Matrix.h"
+
+#include <string>
+#include <vector>
+
+// The data shared by the A and P models. The kernels need each model's view of
+// the data to be contiguous, so there is at most one copy per orientation:
+// the P view is built when the store is first used, since the P model always
+// needs the data, and the A view only if the A model asks for it. A view that
+// is released is freed, and the store itself is freed along with the last
+// model holding it. None of this is thread safe.
+class DenseDataStore
+{
+public:
+    // the input matrix must be alive whenever a view is built, if it can be
+    // referenced it must outlive the store and is used as a view directly
+    // when it already has the right layout
+    DenseDataStore(const Matrix &data, const GapsParameters &params,
+        bool referenceInput=false);
+    DenseDataStore(const std::string &path, const GapsParameters &params,
+        bool referenceInput=false);
+
+    const Matrix& acquire(bool transpose);
+    void release(bool transpose);
+    bool hasView(bool transpose) const;
+    unsigned nRow(bool transpose);
+    unsigned nCol(bool transpose);
+    bool isAModel(bool transpose) const;
+
+    // statistics of the data, the same for both orientations
+    float nonZeroMean() const;
+    float max() const;
+    float sparsity() const;
+private:
+    friend class SharedDenseData;
+
+    DenseDataStore(const DenseDataStore &other); // = delete (no c++11)
+    DenseDataStore& operator=(const DenseDataStore &other); // = delete (no c++11)
+
+    void load();
+    void buildPView();
+    void buildAView();
+
+    const Matrix *mInput; // NULL when reading from a file
+    std::string mPath;
+    Matrix mOwnedPView;
+    Matrix mOwnedAView;
+    const Matrix *mPView; // genes by samples
+    const Matrix *mAView; // samples by genes
+    std::vector<unsigned> mIndices; // subset of genes or samples
+    bool mTransposeData; // the input is samples by genes
+    bool mSubsetGenes;
+    bool mReferenceInput;
+    unsigned mNumThreads; // used to parse the file
+    unsigned mNumGenes;
+    unsigned mNumSamples;
+    float mNonZeroMean;
+    float mMax;
+    float mSparsity;
+    bool mLoaded;
+    unsigned mRefCount; // number of handles to this store
+};
+
+// reference counted handle to a data store, the A and P models co-own one
+// store and whichever of them is destroyed last deletes it - releasing a view
+// after compressing it to bfloat16 only frees that view, never the store
+class SharedDenseData
+{
+public:
+    explicit SharedDenseData(DenseDataStore *store);
+    SharedDenseData(const SharedDenseData &other);
+    SharedDenseData& operator=(const SharedDenseData &other);
+    ~SharedDenseData();
+
+    DenseDataStore* operator->() const { return mStore; }
+private:
+    void decrement();
+
+    DenseDataStore *mStore;
+};
+
+#endif // __COGAPS_DENSE_DATA_STORE_H__
@@ -1,11 +1,39 @@
 #include "DenseNormalModel.h"
 #include "../math/Math.h"
 #include "../math/Random.h"
+#include "../math/SIMDDispatch.h"
 #include "../utils/Archive.h"
 #include "../utils/GapsAssert.h"
 
+#include <vector>
+
 #define GAPS_SQ(x) ((x) * (x))
 
+// sync copies the whole AP matrix when more than 1 / GAPS_FULL_SYNC_RATIO of
+// its columns changed
+#define GAPS_FULL_SYNC_RATIO 8
+
+DenseNormalModel::DenseNormalModel(const SharedDenseData &data, bool transpose,
+bool subsetRows, const GapsParameters &params, float alpha, float maxGibbsMass)
+    :
+mDataStore(data),
+mDMatrix(NULL),
+mMatrix(mDataStore->nCol(transpose), params.nPatterns),
+mOtherMatrix(NULL),
+mAPMatrix(mDataStore->nRow(transpose), mDataStore->nCol(transpose)),
+mChangedAPColumns(mAPMatrix.nCol()),
+mMaxGibbsMass(maxGibbsMass),
+mAnnealingTemp(1.f),
+mLambda(0.f),
+mBfloat16Storage(params.bfloat16Storage),
+mTranspose(transpose)
+{
+    // the data store subsets the data the same way for both models
+    GAPS_ASSERT(subsetRows == (mDataStore->isAModel(transpose)
+        ? !params.subsetGenes : params.subsetGenes));
+    initialize(params, alpha);
+}
+
 void DenseNormalModel::setMatrix(const Matrix &mat)
 {
     mMatrix = mat;
@@ -16,60 +44,117 @@ void DenseNormalModel::setAnnealingTemp(float temp)
     mAnnealingTemp = temp;
 }
 
-// copy transpose of other AP matrix
+// Copy the transpose of the columns the other model changed in its AP matrix.
+// Both models compute the same AP matrix in extraInitialization and after that
+// it only changes through updateAPMatrix, so this keeps them equal with a cost
+// proportional to the number of rows touched by the last update. The samplers
+// alternate update and sync, so the other model has already copied whatever
+// this model changed and those changes can be forgotten. Each changed column
+// is written to a row of this AP matrix, which touches a cache line per
+// element, so once enough columns changed a blocked transpose of the whole
+// matrix is faster.
 void DenseNormalModel::sync(const DenseNormalModel &model, unsigned nThreads)
 {
     GAPS_ASSERT(model.mAPMatrix.nRow() == mAPMatrix.nCol());
     GAPS_ASSERT(model.mAPMatrix.nCol() == mAPMatrix.nRow());
+    mChangedAPColumns.clear();
     unsigned nc = model.mAPMatrix.nCol();
     unsigned nr = model.mAPMatrix.nRow();
-    #pragma omp parallel for num_threads(nThreads)
+    std::vector<unsigned> changed;
+    for (unsigned j = 0; j < nc; ++j)
+    {
+        if (model.mChangedAPColumns.contains(j))
+        {
+            changed.push_back(j);
+        }
+    }
+    if (changed.size() * GAPS_FULL_SYNC_RATIO > nc)
+    {
+        gaps::transpose(model.mAPMatrix, &mAPMatrix, nThreads);
+    }
+    else
+    {
+        unsigned nChanged = changed.size();
+        #pragma omp parallel for num_threads(nThreads)
+        for (unsigned n = 0; n < nChanged; ++n)
+        {
+            unsigned j = changed[n];
+            for (unsigned i = 0; i < nr; ++i)
+            {
+                mAPMatrix(j,i) = model.mAPMatrix(i,j);
+            }
+        }
+    }
+#ifdef GAPS_DEBUG
     for (unsigned j = 0; j < nc; ++j)
     {
         for (unsigned i = 0; i < nr; ++i)
         {
-            mAPMatrix(j,i) = model.mAPMatrix(i,j);
+            GAPS_ASSERT(mAPMatrix(j,i) == model.mAPMatrix(i,j));
         }
     }
+#endif
     mOtherMatrix = &(model.mMatrix); // update pointer
     GAPS_ASSERT(mOtherMatrix->nCol() == mMatrix.nCol());
 }
 
-void DenseNormalModel::extraInitialization()
+// both models compute AP here, the product is exactly the same regardless of
+// the order of the factors which sync relies on
+void DenseNormalModel::extraInitialization(unsigned nThreads)
 {
     GAPS_ASSERT(mOtherMatrix->nRow() == mAPMatrix.nRow());
     GAPS_ASSERT(mOtherMatrix->nCol() == mMatrix.nCol());
     GAPS_ASSERT(mMatrix.nRow() == mAPMatrix.nCol());
-    for (unsigned j = 0; j < mAPMatrix.nCol(); ++j)
+    gaps::multiplyTransposed(*mOtherMatrix, mMatrix, &mAPMatrix, nThreads);
+}
+
+// each column is summed separately and the columns are added in order, so
+// the result doesn't depend on the number of threads
+float DenseNormalModel::chiSq(unsigned nThreads) const
+{
+    unsigned nCol = mAPMatrix.nCol();
+    std::vector<double> colChisq(nCol, 0.0);
+    #pragma omp parallel for num_threads(nThreads)
+    for (unsigned j = 0; j < nCol; ++j)
     {
-        for (unsigned i = 0; i < mAPMatrix.nRow(); ++i)
+        if (mBfloat16Storage)
         {
-            mAPMatrix(i,j) = 0.f;
-            for (unsigned k = 0; k < mMatrix.nCol(); ++k)
-            {
-                mAPMatrix(i,j) += mOtherMatrix->operator()(i,k) * mMatrix(j,k);
-            }
+            colChisq[j] = gaps::simd::kernels().chiSqBf16(mCompressedDMatrix.colPtr(j),
+                mCompressedInvSSqMatrix.colPtr(j), mAPMatrix.getCol(j).ptr(),
+                mAPMatrix.nRow());
         }
+        else
+        {
+            colChisq[j] = gaps::simd::kernels().chiSq(mDMatrix->getCol(j).ptr(),
+                mInvSSqMatrix.getCol(j).ptr(), mAPMatrix.getCol(j).ptr(),
+                mAPMatrix.nRow());
+        }
+    }
+
+    double chisq = 0.0;
+    for (unsigned j = 0; j < nCol; ++j)
+    {
+        chisq += colChisq[j];
     }
+    return static_cast<float>(chisq);
 }
 
-float DenseNormalModel::chiSq() const
+// the change in chi-square since the last call, each AP column is only
+// updated by one thread at a time so they are accumulated separately
+double DenseNormalModel::takeChiSqChange()
 {
-    float chisq = 0.f;
-    for (unsigned i = 0; i < mDMatrix.nRow(); ++i)
+    double change = 0.0;
+    for (unsigned j = 0; j < mChiSqChange.size(); ++j)
     {
-        for (unsigned j = 0; j < mDMatrix.nCol(); ++j)
-        {
-            GAPS_ASSERT(mSMatrix(i,j) > 0.f);
-            chisq += GAPS_SQ((mDMatrix(i,j) - mAPMatrix(i,j)) / mSMatrix(i,j));
-        }
+        change += mChiSqChange[j];
+        mChiSqChange[j] = 0.0;
     }
-    return chisq;
+    return change;
 }
 
 float DenseNormalModel::dataSparsity() const
 {
-    return gaps::sparsity(mDMatrix);
+    return mDataStore->sparsity();
 }
 
 uint64_t DenseNormalModel::nElements() const
@@ -161,100 +246,179 @@ unsigned r2, unsigned c2, float m2, GapsRng *rng)
 // PERFORMANCE CRITICAL
 AlphaParameters DenseNormalModel::alphaParameters(unsigned row, unsigned col)
 {
-    unsigned size = mDMatrix.nRow();
-    const float *D = mDMatrix.getCol(row).ptr();
-    const float *S = mSMatrix.getCol(row).ptr();
-    const float *AP = mAPMatrix.getCol(row).ptr();
-    const float *mat = mOtherMatrix->getCol(col).ptr();
-
-    gaps::simd::PackedFloat pMat, pD, pAP, pS;
-    gaps::simd::PackedFloat partialS(0.f), partialS_mu(0.f);
-    for (gaps::simd::Index i(0); i < size; ++i)
-    {   
-        pMat.load(mat + i);
-        pD.load(D + i);
-        pAP.load(AP + i);
-        pS.load(S + i);
-        gaps::simd::PackedFloat ratio(pMat / (pS * pS));
-        partialS += pMat * ratio;
-        partialS_mu += ratio * (pD - pAP);
+    float s = 0.f, s_mu = 0.f;
+    if (mBfloat16Storage)
+    {
+        gaps::simd::kernels().alphaParametersBf16(mOtherMatrix->getCol(col).ptr(),
+            mCompressedDMatrix.colPtr(row), mCompressedInvSSqMatrix.colPtr(row),
+            mAPMatrix.getCol(row).ptr(), mAPMatrix.nRow(), &s, &s_mu);
+    }
+    else
+    {
+        gaps::simd::kernels().alphaParameters(mOtherMatrix->getCol(col).ptr(),
+            mDMatrix->getCol(row).ptr(), mInvSSqMatrix.getCol(row).ptr(),
+            mAPMatrix.getCol(row).ptr(), mAPMatrix.nRow(), &s, &s_mu);
     }
-    return AlphaParameters(partialS.scalar(), partialS_mu.scalar());
+    return AlphaParameters(s, s_mu);
 }
 
 // PERFORMANCE CRITICAL
 AlphaParameters DenseNormalModel::alphaParameters(unsigned r1, unsigned c1,
 unsigned r2, unsigned c2)
 {
+    float s = 0.f, s_mu = 0.f;
     if (r1 == r2)
     {
-        unsigned size = mDMatrix.nRow();
-        const float *D = mDMatrix.getCol(r1).ptr();
-        const float *S = mSMatrix.getCol(r1).ptr();
-        const float *AP = mAPMatrix.getCol(r1).ptr();
-        const float *mat1 = mOtherMatrix->getCol(c1).ptr();
-        const float *mat2 = mOtherMatrix->getCol(c2).ptr();
-
-        gaps::simd::PackedFloat pMat1, pMat2, pD, pAP, pS;
-        gaps::simd::PackedFloat packedS(0.f), packedS_mu(0.f);
-        for (gaps::simd::Index i(0); i < size; ++i)
-        {   
-            pMat1.load(mat1 + i);
-            pMat2.load(mat2 + i);
-            pD.load(D + i);
-            pAP.load(AP + i);
-            pS.load(S + i);
-            gaps::simd::PackedFloat ratio((pMat1 - pMat2) / (pS * pS));
-            packedS += (pMat1 - pMat2) * ratio;
-            packedS_mu += ratio * (pD - pAP);
+        if (mBfloat16Storage)
+        {
+            gaps::simd::kernels().alphaParametersDiffBf16(mOtherMatrix->getCol(c1).ptr(),
+                mOtherMatrix->getCol(c2).ptr(), mCompressedDMatrix.colPtr(r1),
+                mCompressedInvSSqMatrix.colPtr(r1), mAPMatrix.getCol(r1).ptr(),
+                mAPMatrix.nRow(), &s, &s_mu);
+        }
+        else
+        {
+            gaps::simd::kernels().alphaParametersDiff(mOtherMatrix->getCol(c1).ptr(),
+                mOtherMatrix->getCol(c2).ptr(), mDMatrix->getCol(r1).ptr(),
+                mInvSSqMatrix.getCol(r1).ptr(), mAPMatrix.getCol(r1).ptr(),
+                mAPMatrix.nRow(), &s, &s_mu);
         }
-        return AlphaParameters(packedS.scalar(), packedS_mu.scalar());
+        return AlphaParameters(s, s_mu);
+    }
+
+    // the changes to AP don't overlap, but both columns are read in one pass
+    if (mBfloat16Storage)
+    {
+        gaps::simd::kernels().alphaParametersPairBf16(mOtherMatrix->getCol(c1).ptr(),
+            mCompressedDMatrix.colPtr(r1), mCompressedInvSSqMatrix.colPtr(r1),
+            mAPMatrix.getCol(r1).ptr(), mOtherMatrix->getCol(c2).ptr(),
+            mCompressedDMatrix.colPtr(r2), mCompressedInvSSqMatrix.colPtr(r2),
+            mAPMatrix.getCol(r2).ptr(), mAPMatrix.nRow(), &s, &s_mu);
+    }
+    else
+    {
+        gaps::simd::kernels().alphaParametersPair(mOtherMatrix->getCol(c1).ptr(),
+            mDMatrix->getCol(r1).ptr(), mInvSSqMatrix.getCol(r1).ptr(),
+            mAPMatrix.getCol(r1).ptr(), mOtherMatrix->getCol(c2).ptr(),
+            mDMatrix->getCol(r2).ptr(), mInvSSqMatrix.getCol(r2).ptr(),
+            mAPMatrix.getCol(r2).ptr(), mAPMatrix.nRow(), &s, &s_mu);
     }
-    return alphaParameters(r1, c1) + alphaParameters(r2, c2);
+    return AlphaParameters(s, s_mu);
 }
 
 // PERFORMANCE CRITICAL
 AlphaParameters DenseNormalModel::alphaParametersWithChange(unsigned row,
 unsigned col, float ch)
 {
-    unsigned size = mDMatrix.nRow();
-    const float *D = mDMatrix.getCol(row).ptr();
-    const float *S = mSMatrix.getCol(row).ptr();
-    const float *AP = mAPMatrix.getCol(row).ptr();
-    const float *mat = mOtherMatrix->getCol(col).ptr();
-
-    gaps::simd::PackedFloat pCh(ch);
-    gaps::simd::PackedFloat pMat, pD, pAP, pS;
-    gaps::simd::PackedFloat packedS(0.f), packedS_mu(0.f);
-    for (gaps::simd::Index i(0); i < size; ++i)
-    {   
-        pMat.load(mat + i);
-        pD.load(D + i);
-        pAP.load(AP + i);
-        pS.load(S + i);
-        gaps::simd::PackedFloat ratio(pMat / (pS * pS));
-        packedS += pMat * ratio;
-        packedS_mu += ratio * (pD - (pAP + pCh * pMat));
+    float s = 0.f, s_mu = 0.f;
+    if (mBfloat16Storage)
+    {
+        gaps::simd::kernels().alphaParametersWithChangeBf16(mOtherMatrix->getCol(col).ptr(),
+            mCompressedDMatrix.colPtr(row), mCompressedInvSSqMatrix.colPtr(row),
+            mAPMatrix.getCol(row).ptr(), ch, mAPMatrix.nRow(), &s, &s_mu);
+    }
+    else
+    {
+        gaps::simd::kernels().alphaParametersWithChange(mOtherMatrix->getCol(col).ptr(),
+            mDMatrix->getCol(row).ptr(), mInvSSqMatrix.getCol(row).ptr(),
+            mAPMatrix.getCol(row).ptr(), ch, mAPMatrix.nRow(), &s, &s_mu);
     }
-    return AlphaParameters(packedS.scalar(), packedS_mu.scalar());
+    return AlphaParameters(s, s_mu);
 }
 
 // PERFORMANCE CRITICAL
 void DenseNormalModel::updateAPMatrix(unsigned row, unsigned col, float delta)
 {
-    const float *other = mOtherMatrix->getCol(col).ptr();
-    float *ap = mAPMatrix.getCol(row).ptr();
-    unsigned size = mAPMatrix.nRow();
+    mChangedAPColumns.insert(row);
+    if (mChiSqChange.empty())
+    {
+        gaps::simd::kernels().addScaled(mAPMatrix.getCol(row).ptr(),
+            mOtherMatrix->getCol(col).ptr(), delta, mAPMatrix.nRow());
+    }
+    else if (mBfloat16Storage)
+    {
+        mChiSqChange[row] += gaps::simd::kernels().addScaledChiSqBf16(
+            mAPMatrix.getCol(row).ptr(), mOtherMatrix->getCol(col).ptr(), delta,
+            mCompressedDMatrix.colPtr(row), mCompressedInvSSqMatrix.colPtr(row),
+            mAPMatrix.nRow());
+    }
+    else
+    {
+        mChiSqChange[row] += gaps::simd::kernels().addScaledChiSq(
+            mAPMatrix.getCol(row).ptr(), mOtherMatrix->getCol(col).ptr(), delta,
+            mDMatrix->getCol(row).ptr(), mInvSSqMatrix.getCol(row).ptr(),
+            mAPMatrix.nRow());
+    }
+}
+
+// the data is needed by any model that is sampled and by the P model, which is
+// used to calculate chi-square, so only a fixed A matrix goes without it
+void DenseNormalModel::initialize(const GapsParameters &params, float alpha)
+{
+    mLambda = alpha * std::sqrt(nPatterns() / mDataStore->nonZeroMean());
+    mMaxGibbsMass = mMaxGibbsMass / mLambda;
+
+    if (mDataStore->isAModel(mTranspose) && params.whichMatrixFixed == 'A')
+    {
+        return;
+    }
+    mDMatrix = &(mDataStore->acquire(mTranspose));
+    mInvSSqMatrix = gaps::pmax(*mDMatrix, 0.1f);
+    if (params.trackChiSq)
+    {
+        mChiSqChange.assign(mAPMatrix.nCol(), 0.0);
+    }
+    invertUncertainty();
+    if (mBfloat16Storage)
+    {
+        compressStorage();
+    }
+}
+
+bool DenseNormalModel::holdsData() const
+{
+    return mDMatrix != NULL || !mCompressedDMatrix.empty();
+}
+
+// S itself is never needed after this, so it is replaced with 1 / S^2 in place
+// rather than keeping another copy of the data around
+void DenseNormalModel::invertUncertainty()
+{
+    GAPS_ASSERT(mInvSSqMatrix.nRow() == mAPMatrix.nRow());
+    GAPS_ASSERT(mInvSSqMatrix.nCol() == mAPMatrix.nCol());
+    for (unsigned j = 0; j < mInvSSqMatrix.nCol(); ++j)
+    {
+        for (unsigned i = 0; i < mInvSSqMatrix.nRow(); ++i)
+        {
+            GAPS_ASSERT(mInvSSqMatrix(i,j) > 0.f);
+            mInvSSqMatrix(i,j) = 1.f / GAPS_SQ(mInvSSqMatrix(i,j));
+        }
+    }
+    mInvSSqMatrix.pad(1.f); // so that SIMD operations don't produce NaN
+}
 
-    gaps::simd::PackedFloat pOther, pAP;
-    gaps::simd::PackedFloat pDelta(delta);
-    for (gaps::simd::Index i(0); i < size; ++i)
+// the float matrices are released once they are compressed, if the
+// uncertainty is set after construction only it needs to be compressed
+void DenseNormalModel::compressStorage()
+{
+    if (mDMatrix != NULL)
     {
-        pOther.load(other + i);
-        pAP.load(ap + i);
-        pAP += pDelta * pOther;
-        pAP.store(ap + i);
+        mCompressedDMatrix = Bfloat16Matrix(*mDMatrix, 0.f);
+        mDMatrix = NULL;
+        mDataStore->release(mTranspose);
     }
+    mCompressedInvSSqMatrix = Bfloat16Matrix(mInvSSqMatrix, 1.f);
+    mInvSSqMatrix = Matrix();
+}
+
+float DenseNormalModel::dataValue(unsigned i, unsigned j) const
+{
+    return mBfloat16Storage ? mCompressedDMatrix(i,j) : (*mDMatrix)(i,j);
+}
+
+float DenseNormalModel::invSSqValue(unsigned i, unsigned j) const
+{
+    return mBfloat16Storage ? mCompressedInvSSqMatrix(i,j) : mInvSSqMatrix(i,j);
 }
 
 Archive& operator<<(Archive &ar, const DenseNormalModel &m)
@@ -2,12 +2,16 @@
 #define __COGAPS_DENSE_NORMAL_MODEL_H__
 
 #include "AlphaParameters.h"
+#include "DenseDataStore.h"
 #include "../GapsParameters.h"
+#include "../data_structures/Bfloat16Matrix.h"
+#include "../data_structures/HashSets.h"
 #include "../data_structures/Matrix.h"
 #include "../math/MatrixMath.h"
 #include "../utils/GapsPrint.h"
 
 #include <cmath>
+#include <vector>
 
 class GapsStatistics;
 class Archive;
@@ -15,6 +19,8 @@ class Archive;
 class DenseNormalModel
 {
 public:
+    DenseNormalModel(const SharedDenseData &data, bool transpose, bool subsetRows,
+        const GapsParameters &params, float alpha, float maxGibbsMass);
     template <class DataType>
     DenseNormalModel(const DataType &data, bool transpose, bool subsetRows,
         const GapsParameters &params, float alpha, float maxGibbsMass);
@@ -24,8 +30,9 @@ public:
     void setMatrix(const Matrix &mat);
     void setAnnealingTemp(float temp);
     void sync(const DenseNormalModel &model, unsigned nThreads=1);
-    void extraInitialization();
-    float chiSq() const;
+    void extraInitialization(unsigned nThreads=1);
+    float chiSq(unsigned nThreads=1) const;
+    double takeChiSqChange();
     float dataSparsity() const;
     friend Archive& operator<<(Archive &ar, const DenseNormalModel &m);
     friend Archive& operator>>(Archive &ar, DenseNormalModel &m);
@@ -52,47 +59,65 @@ protected:
     AlphaParameters alphaParameters(unsigned r1, unsigned c1, unsigned r2, unsigned c2);
     AlphaParameters alphaParametersWithChange(unsigned row, unsigned col, float ch);
     void updateAPMatrix(unsigned row, unsigned col, float delta);
+    void initialize(const GapsParameters &params, float alpha);
+    bool holdsData() const;
+    void invertUncertainty();
+    void compressStorage();
+    float dataValue(unsigned i, unsigned j) const;
+    float invSSqValue(unsigned i, unsigned j) const;
 
-    Matrix mDMatrix; // samples by genes for A, genes by samples for P
+    SharedDenseData mDataStore; // shared with the other model
+    const Matrix *mDMatrix; // samples by genes for A, genes by samples for P
     Matrix mMatrix; // genes by patterns for A, samples by patterns for P
     const Matrix *mOtherMatrix; // pointer to P if this is A, and vice versa
-    Matrix mSMatrix; // uncertainty values for each data point
+    Matrix mInvSSqMatrix; // 1 / S^2 for the uncertainty S of each data point
     Matrix mAPMatrix; // cached product of A and P
+    FixedHashSetU32 mChangedAPColumns; // changed since the other model synced
+    Bfloat16Matrix mCompressedDMatrix; // replaces mDMatrix with bfloat16 storage
+    Bfloat16Matrix mCompressedInvSSqMatrix; // replaces mInvSSqMatrix with bfloat16 storage
+    std::vector<double> mChiSqChange; // per AP column, empty unless tracking chi-square
     float mMaxGibbsMass;
     float mAnnealingTemp;
     float mLambda;
+    bool mBfloat16Storage;
+    bool mTranspose;
 };
 
+// the model gets its own copy of the data, not shared with any other model
 template <class DataType>
 DenseNormalModel::DenseNormalModel(const DataType &data, bool transpose,
 bool subsetRows, const GapsParameters &params, float alpha, float maxGibbsMass)
     :
-mDMatrix(data, transpose, subsetRows, params.dataIndicesSubset),
-mMatrix(mDMatrix.nCol(), params.nPatterns),
+mDataStore(new DenseDataStore(data, params)),
+mDMatrix(NULL),
+mMatrix(mDataStore->nCol(transpose), params.nPatterns),
 mOtherMatrix(NULL),
-mSMatrix(gaps::pmax(mDMatrix, 0.1f)),
-mAPMatrix(mDMatrix.nRow(), mDMatrix.nCol()),
+mAPMatrix(mDataStore->nRow(transpose), mDataStore->nCol(transpose)),
+mChangedAPColumns(mAPMatrix.nCol()),
 mMaxGibbsMass(maxGibbsMass),
 mAnnealingTemp(1.f),
-mLambda(0.f)
+mLambda(0.f),
+mBfloat16Storage(params.bfloat16Storage),
+mTranspose(transpose)
 {
-    float meanD = gaps::nonZeroMean(mDMatrix);
-    mLambda = alpha * std::sqrt(nPatterns() / meanD);
-    mMaxGibbsMass = mMaxGibbsMass / mLambda;
-
-    if (gaps::max(mDMatrix) > 50.f)
-    {
-        gaps_printf("\nWarning: Large values detected, is data log transformed?\n");
-    }
-    mSMatrix.pad(1.f); // so that SIMD operations don't divide by zero
+    initialize(params, alpha);
 }
 
 template <class DataType>
 void DenseNormalModel::setUncertainty(const DataType &unc, bool transpose,
 bool subsetRows, const GapsParameters &params)
 {
-    mSMatrix = Matrix(unc, transpose, subsetRows, params.dataIndicesSubset);
-    mSMatrix.pad(1.f); // so that SIMD operations don't divide by zero
+    if (!holdsData())
+    {
+        return;
+    }
+    mInvSSqMatrix = Matrix(unc, transpose, subsetRows, params.dataIndicesSubset,
+        params.maxThreads);
+    invertUncertainty();
+    if (mBfloat16Storage)
+    {
+        compressStorage();
+    }
 }
 
 #endif // __COGAPS_DENSE_STORAGE_POLICY_H__
\ No newline at end of file
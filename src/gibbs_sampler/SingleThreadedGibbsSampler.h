@@ -42,6 +42,8 @@ public:
         GapsRandomState *randState);
     unsigned nAtoms() const;
     float getAverageQueueLength() const;
+    std::vector<uint64_t> queueLengthHistogram() const;
+    std::vector<uint64_t> conflictHistogram() const;
     void update(unsigned nSteps, unsigned nThreads);
     friend Archive& operator<< <DataModel> (Archive &ar, const SingleThreadedGibbsSampler &s);
     friend Archive& operator>> <DataModel> (Archive &ar, SingleThreadedGibbsSampler &s);
@@ -91,6 +93,18 @@ float SingleThreadedGibbsSampler<DataModel>::getAverageQueueLength() const
     return 0.f;
 }
 
+template <class DataModel>
+std::vector<uint64_t> SingleThreadedGibbsSampler<DataModel>::queueLengthHistogram() const
+{
+    return std::vector<uint64_t>();
+}
+
+template <class DataModel>
+std::vector<uint64_t> SingleThreadedGibbsSampler<DataModel>::conflictHistogram() const
+{
+    return std::vector<uint64_t>();
+}
+
 template <class DataModel>
 char SingleThreadedGibbsSampler<DataModel>::getUpdateType() const
 {
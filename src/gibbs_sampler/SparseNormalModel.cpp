@@ -1,5 +1,4 @@
 #include "SparseNormalModel.h"
-#include "../data_structures/SparseIterator.h"
 #include "../math/Math.h"
 #include "../math/Random.h"
 #include "../math/MatrixMath.h"
@@ -7,7 +6,12 @@
 #include "../utils/Archive.h"
 #include "../utils/GapsAssert.h"
 
-#define GAPS_SQ(x) ((x) * (x))
+#include <algorithm>
+#include <vector>
+
+// the lookup tables are recomputed from scratch when more than
+// 1 / GAPS_FULL_LOOKUP_RATIO of the rows of the other matrix changed
+#define GAPS_FULL_LOOKUP_RATIO 4
 
 #define COUNT_LOWER_BITS(u, pos) __builtin_popcountll((u) & ((1ull << (pos)) - 1ull))
 #define CLEAR_LOWER_BITS(u, pos) (((pos) == 63) ? 0 : (u) & ~((1ull << ((pos) + 1ull)) - 1ull))
@@ -24,39 +28,158 @@ void SparseNormalModel::setAnnealingTemp(float temp)
     mAnnealingTemp = temp;
 }
 
-void SparseNormalModel::sync(const SparseNormalModel &model, unsigned nThreads) // NOLINT
+// Copy the AP values at the non-zeros of the columns the other model changed,
+// see DenseNormalModel::sync. The non-zeros of a column in the other model
+// are spread over the columns of this model, the position of each one is
+// recorded when the data is indexed. The rows this model changed are copied
+// into mSyncedMatrix, the other model has already used their old values.
+void SparseNormalModel::sync(const SparseNormalModel &model, unsigned nThreads)
 {
-    mOtherMatrix = &(model.mMatrix);
-    generateLookupTables();
+    GAPS_ASSERT(model.mAPNonZero.size() == mDMatrix.nRow());
+    for (unsigned i = 0; i < mSyncedMatrix.nCol(); ++i)
+    {
+        if (mChangedAPColumns.contains(i))
+        {
+            const float *row = mMatrix.getRow(i).ptr();
+            std::copy(row, row + mMatrix.nCol(), mSyncedMatrix.getCol(i).ptr());
+        }
+    }
+    mChangedAPColumns.clear();
+    std::vector<unsigned> changed;
+    for (unsigned j = 0; j < model.mAPNonZero.size(); ++j)
+    {
+        if (model.mChangedAPColumns.contains(j))
+        {
+            changed.push_back(j);
+        }
+    }
+
+    // every non-zero is written by exactly one column of the other model
+    unsigned nChanged = changed.size();
+    #pragma omp parallel for num_threads(nThreads)
+    for (unsigned n = 0; n < nChanged; ++n)
+    {
+        unsigned j = changed[n];
+        const std::vector<unsigned> &indices(model.mDMatrix.getCol(j).getIndices());
+        for (unsigned k = 0; k < indices.size(); ++k)
+        {
+            mAPNonZero[indices[k]][model.mTransposedPos[j][k]] = model.mAPNonZero[j][k];
+        }
+    }
+#ifdef GAPS_DEBUG
+    for (unsigned j = 0; j < model.mAPNonZero.size(); ++j)
+    {
+        const std::vector<unsigned> &indices(model.mDMatrix.getCol(j).getIndices());
+        for (unsigned k = 0; k < indices.size(); ++k)
+        {
+            GAPS_ASSERT(mAPNonZero[indices[k]][model.mTransposedPos[j][k]]
+                == model.mAPNonZero[j][k]);
+        }
+    }
+#endif
+
+    // the first sync, and any sync after most of the other matrix changed,
+    // computes the lookup tables from scratch
+    if (mOtherMatrix != &(model.mMatrix)
+    || nChanged * GAPS_FULL_LOOKUP_RATIO > model.mMatrix.nRow())
+    {
+        mOtherMatrix = &(model.mMatrix);
+        generateLookupTables();
+    }
+    else
+    {
+        updateLookupTables(model, changed);
+    }
 }
 
-// required for GibbsSampler interface
-void SparseNormalModel::extraInitialization()
+// both models compute AP at the non-zeros here, the dot product is exactly the
+// same regardless of the order of the factors which sync relies on
+void SparseNormalModel::extraInitialization(unsigned nThreads)
 {
-    // nop - not needed
+    GAPS_ASSERT(mOtherMatrix->nRow() == mDMatrix.nRow());
+    unsigned nCol = mAPNonZero.size();
+    #pragma omp parallel for num_threads(nThreads)
+    for (unsigned j = 0; j < nCol; ++j)
+    {
+        const std::vector<unsigned> &indices(mDMatrix.getCol(j).getIndices());
+        for (unsigned k = 0; k < indices.size(); ++k)
+        {
+            mAPNonZero[j][k] = gaps::dot(mMatrix.getRow(j),
+                mOtherMatrix->getRow(indices[k]));
+        }
+    }
+    mSyncedMatrix = Matrix(mMatrix.nCol(), mMatrix.nRow());
+    for (unsigned i = 0; i < mMatrix.nRow(); ++i)
+    {
+        const float *row = mMatrix.getRow(i).ptr();
+        std::copy(row, row + mMatrix.nCol(), mSyncedMatrix.getCol(i).ptr());
+    }
+
+    // a run started from a checkpoint computes the lookup tables from
+    // scratch, so they are recomputed here as well to match it
+    if (mOtherMatrix != NULL)
+    {
+        generateLookupTables();
+    }
 }
 
-float SparseNormalModel::chiSq() const
+// The sum of AP^2 over a whole column j is m_j^T Z2 m_j where m_j is row j of
+// mMatrix, so the zeros of the data never need to be visited. The non-zeros
+// then replace their AP^2 with the actual term, using the cached AP values.
+// This requires the lookup tables and mAPNonZero to be current, i.e. the
+// other model has not changed since this one synced. Each column is summed
+// separately in double precision and the columns are added in order, so the
+// result doesn't depend on the number of threads.
+float SparseNormalModel::chiSq(unsigned nThreads) const
 {
-    float chisq = 0.f;
-    for (unsigned j = 0; j < mDMatrix.nCol(); ++j)
+    unsigned nCol = mDMatrix.nCol();
+    unsigned nPatterns = mZ1.size();
+    std::vector<double> colChisq(nCol, 0.0);
+    #pragma omp parallel for num_threads(nThreads)
+    for (unsigned j = 0; j < nCol; ++j)
     {
-        for (unsigned i = 0; i < mDMatrix.nRow(); ++i)
+        double chisq = 0.0;
+        const float *m = mMatrix.getRow(j).ptr();
+        for (unsigned p = 0; p < nPatterns; ++p)
         {
-            float dot = gaps::dot(mMatrix.getRow(j), mOtherMatrix->getRow(i));
-            chisq += dot * dot;
+            double cross = 0.0;
+            for (unsigned q = p + 1; q < nPatterns; ++q)
+            {
+                cross += mZ2Sum[p * nPatterns + q] * m[q];
+            }
+            chisq += m[p] * (mZ2Sum[p * nPatterns + p] * m[p] + 2.0 * cross);
         }
 
-        SparseIterator<1> it(mDMatrix.getCol(j));
-        while (!it.atEnd())
+        const std::vector<float> &data(mDMatrix.getCol(j).getData());
+        const std::vector<float> &ap(mAPNonZero[j]);
+        const std::vector<float> &weight(mWeightNonZero[j]);
+        for (unsigned k = 0; k < data.size(); ++k)
         {
-            float dot = gaps::dot(mMatrix.getRow(j), mOtherMatrix->getRow(it.getIndex()));
-            float dsq = get<1>(it) * get<1>(it);
-            chisq += 1 + dot * (dot - 2 * get<1>(it) - dsq * dot) / dsq;
-            it.next();
+            double diff = data[k] - ap[k];
+            chisq += weight[k] * diff * diff - static_cast<double>(ap[k]) * ap[k];
         }
+        colChisq[j] = chisq;
+    }
+
+    double chisq = 0.0;
+    for (unsigned j = 0; j < nCol; ++j)
+    {
+        chisq += colChisq[j];
+    }
+    return static_cast<float>(chisq * mBeta);
+}
+
+// the change in chi-square since the last call, each row is only changed by
+// one thread at a time so they are accumulated separately
+double SparseNormalModel::takeChiSqChange()
+{
+    double change = 0.0;
+    for (unsigned i = 0; i < mChiSqChange.size(); ++i)
+    {
+        change += mChiSqChange[i];
+        mChiSqChange[i] = 0.0;
     }
-    return chisq * mBeta;
+    return change;
 }
 
 float SparseNormalModel::dataSparsity() const
@@ -101,14 +224,21 @@ bool SparseNormalModel::canUseGibbs(unsigned c1, unsigned c2) const
 
 void SparseNormalModel::changeMatrix(unsigned row, unsigned col, float delta)
 {
+    // values below epsilon are zeroed out, so AP uses the actual change
+    float oldVal = mMatrix(row, col);
+    addChiSqChange(row, col, delta);
     mMatrix.add(row, col, delta);
+    updateAPNonZero(row, col, mMatrix(row, col) - oldVal);
     GAPS_ASSERT(mMatrix(row, col) >= 0.f);
 }
 
 void SparseNormalModel::safelyChangeMatrix(unsigned row, unsigned col, float delta)
 {
-    float newVal = gaps::max(mMatrix(row, col) + delta, 0.f);
+    float oldVal = mMatrix(row, col);
+    float newVal = gaps::max(oldVal + delta, 0.f);
+    addChiSqChange(row, col, newVal - oldVal);
     mMatrix.set(row, col, newVal);
+    updateAPNonZero(row, col, mMatrix(row, col) - oldVal);
     GAPS_ASSERT(mMatrix(row, col) >= 0.f);
 }
 
@@ -157,10 +287,36 @@ AlphaParameters SparseNormalModel::alphaParameters(unsigned row, unsigned col)
     const std::vector<uint64_t> &bitflags_D(D.getBitFlags());
     const std::vector<uint64_t> &bitflags_V(V.getBitFlags());
     const std::vector<float> &data(D.getData());
+    const std::vector<float> &ap(mAPNonZero[row]);
+    const std::vector<float> &weight(mWeightNonZero[row]);
 
     float s = mZ1[col];
     float s_mu = -1.f * gaps::dot(mMatrix.getRow(row), mZ2.getCol(col));
 
+    if (D.preferIndices())
+    {
+        // probe the dense values of V at each non-zero of D
+        const std::vector<unsigned> &indices(D.getIndices());
+        const float *v = V.ptr();
+        for (unsigned k = 0; k < indices.size(); ++k)
+        {
+            float v_val = v[indices[k]];
+            if (v_val != 0.f)
+            {
+                float ap_val = ap[k];
+                float w = weight[k];
+                float d_val = data[k];
+
+                // compute terms for s and s_mu
+                float term1 = v_val * w;
+                float term2 = v_val - term1;
+                s -= v_val * term2;
+                s_mu += term1 * d_val + term2 * ap_val;
+            }
+        }
+        return AlphaParameters(s, s_mu) * mBeta;
+    }
+
     unsigned sparseIndex = 0;
     unsigned sz = bitflags_D.size();
     for (unsigned i = 0; i < sz; ++i)
@@ -178,14 +334,15 @@ AlphaParameters SparseNormalModel::alphaParameters(unsigned row, unsigned col)
             // get the needed data
             unsigned v_ndx = 64 * i + index;
             float v_val = V[v_ndx];
+            float ap_val = ap[sparseIndex];
+            float w = weight[sparseIndex];
             float d_val = data[sparseIndex++];
 
             // compute terms for s and s_mu
-            float term1 = v_val / d_val;
-            float term2 = v_val - term1 / d_val;
-            s += term1 * term1 - v_val * v_val;
-            s_mu += term1 + term2 * gaps::dot(mMatrix.getRow(row),
-                mOtherMatrix->getRow(v_ndx));
+            float term1 = v_val * w;
+            float term2 = v_val - term1;
+            s -= v_val * term2;
+            s_mu += term1 * d_val + term2 * ap_val;
         }
         sparseIndex += COUNT_BITS(d_flags); // skip over any remaining indices
     }
@@ -201,11 +358,38 @@ unsigned col, float ch)
     const std::vector<uint64_t> &bitflags_D(D.getBitFlags());
     const std::vector<uint64_t> &bitflags_V(V.getBitFlags());
     const std::vector<float> &data(D.getData());
+    const std::vector<float> &ap(mAPNonZero[row]);
+    const std::vector<float> &weight(mWeightNonZero[row]);
 
     float s = mZ1[col];
     float s_mu = -1.f * gaps::dot(mMatrix.getRow(row), mZ2.getCol(col));
     s_mu -= ch * mZ2(col,col);
 
+    if (D.preferIndices())
+    {
+        // probe the dense values of V at each non-zero of D
+        const std::vector<unsigned> &indices(D.getIndices());
+        const float *v = V.ptr();
+        for (unsigned k = 0; k < indices.size(); ++k)
+        {
+            float v_val = v[indices[k]];
+            if (v_val != 0.f)
+            {
+                float ap_val = ap[k];
+                float w = weight[k];
+                float d_val = data[k];
+
+                // compute terms for s and s_mu
+                float term1 = v_val * w;
+                float term2 = v_val - term1;
+                s -= v_val * term2;
+                s_mu += term1 * d_val + term2 * ap_val;
+                s_mu += term2 * v_val * ch;
+            }
+        }
+        return AlphaParameters(s, s_mu) * mBeta;
+    }
+
     unsigned sparseIndex = 0;
     unsigned sz = bitflags_D.size();
     for (unsigned i = 0; i < sz; ++i)
@@ -223,15 +407,16 @@ unsigned col, float ch)
             // get the needed data
             unsigned v_ndx = 64 * i + index;
             float v_val = V[v_ndx];
+            float ap_val = ap[sparseIndex];
+            float w = weight[sparseIndex];
             float d_val = data[sparseIndex++];
 
             // compute terms for s and s_mu
-            float term1 = v_val / d_val;
-            float term2 = v_val - term1 / d_val;
-            s += term1 * term1 - v_val * v_val;
-            s_mu += term1 + term2 * gaps::dot(mMatrix.getRow(row),
-                mOtherMatrix->getRow(v_ndx));
-            s_mu += term2 * mOtherMatrix->operator()(v_ndx, col) * ch;
+            float term1 = v_val * w;
+            float term2 = v_val - term1;
+            s -= v_val * term2;
+            s_mu += term1 * d_val + term2 * ap_val;
+            s_mu += term2 * v_val * ch;
         }
         sparseIndex += COUNT_BITS(d_flags);
     }
@@ -251,11 +436,39 @@ unsigned r2, unsigned c2)
         const std::vector<uint64_t> &bitflags_V1(V1.getBitFlags());
         const std::vector<uint64_t> &bitflags_V2(V2.getBitFlags());
         const std::vector<float> &data(D.getData());
+        const std::vector<float> &ap(mAPNonZero[r1]);
+        const std::vector<float> &weight(mWeightNonZero[r1]);
 
         float s = mZ1[c1] - 2.f * mZ2(c1,c2) + mZ1[c2];
         float s_mu = -1.f * gaps::dot_diff(mMatrix.getRow(r1), mZ2.getCol(c1),
             mZ2.getCol(c2));
 
+        if (D.preferIndices())
+        {
+            const std::vector<unsigned> &indices(D.getIndices());
+            const float *v1 = V1.ptr();
+            const float *v2 = V2.ptr();
+            for (unsigned k = 0; k < indices.size(); ++k)
+            {
+                float v1_val = v1[indices[k]];
+                float v2_val = v2[indices[k]];
+                if (v1_val != 0.f || v2_val != 0.f)
+                {
+                    float ap_val = ap[k];
+                    float w = weight[k];
+                    float d_val = data[k];
+
+                    // compute terms for s and s_mu
+                    float term1 = 1.f - w;
+                    float v_diff = v1_val - v2_val;
+
+                    s -= v_diff * v_diff * term1;
+                    s_mu += v_diff * (ap_val * term1 + w * d_val);
+                }
+            }
+            return AlphaParameters(s, s_mu) * mBeta;
+        }
+
         unsigned sparseIndex = 0;
         unsigned sz = bitflags_D.size();
         for (unsigned i = 0; i < sz; ++i)
@@ -274,15 +487,16 @@ unsigned r2, unsigned c2)
                 unsigned v_ndx = 64 * i + index;
                 float v1_val = V1[v_ndx];
                 float v2_val = V2[v_ndx];
+                float ap_val = ap[sparseIndex];
+                float w = weight[sparseIndex];
                 float d_val = data[sparseIndex++];
 
-                float d_recip = 1.f / d_val;
-                float term1 = 1.f - d_recip * d_recip;
+                // compute terms for s and s_mu
+                float term1 = 1.f - w;
                 float v_diff = v1_val - v2_val;
-                float ap = gaps::dot(mMatrix.getRow(r1), mOtherMatrix->getRow(v_ndx));
 
                 s -= v_diff * v_diff * term1;
-                s_mu += v_diff * (ap * term1 + d_recip);
+                s_mu += v_diff * (ap_val * term1 + w * d_val);
             }
             sparseIndex += COUNT_BITS(d_flags);
         }
@@ -291,23 +505,154 @@ unsigned r2, unsigned c2)
     return alphaParameters(r1, c1) + alphaParameters(r2, c2);
 }
 
+// chi-square is quadratic in each element of the matrix, the alpha parameters
+// before the change give its exact change as delta * (delta * s - 2 * s_mu)
+void SparseNormalModel::addChiSqChange(unsigned row, unsigned col, float delta)
+{
+    if (!mChiSqChange.empty())
+    {
+        AlphaParameters alpha = alphaParameters(row, col);
+        mChiSqChange[row] += delta * (delta * alpha.s - 2.f * alpha.s_mu);
+    }
+}
+
+// PERFORMANCE_CRITICAL
+void SparseNormalModel::updateAPNonZero(unsigned row, unsigned col, float delta)
+{
+    mChangedAPColumns.insert(row);
+    const float *v = mOtherMatrix->getCol(col).ptr();
+    const std::vector<unsigned> &indices(mDMatrix.getCol(row).getIndices());
+    std::vector<float> &ap(mAPNonZero[row]);
+    for (unsigned k = 0; k < ap.size(); ++k)
+    {
+        ap[k] += delta * v[indices[k]];
+    }
+}
+
+// the k-th non-zero in row i of the data is the k-th non-zero in column i of
+// the data seen by the other model, since both are ordered by the column here
+void SparseNormalModel::indexNonZeros()
+{
+    std::vector<unsigned> nInRow(mDMatrix.nRow(), 0);
+    mAPNonZero.resize(mDMatrix.nCol());
+    mTransposedPos.resize(mDMatrix.nCol());
+    mWeightNonZero.resize(mDMatrix.nCol());
+    for (unsigned j = 0; j < mDMatrix.nCol(); ++j)
+    {
+        const std::vector<unsigned> &indices(mDMatrix.getCol(j).getIndices());
+        const std::vector<float> &data(mDMatrix.getCol(j).getData());
+        for (unsigned k = 0; k < indices.size(); ++k)
+        {
+            mTransposedPos[j].push_back(nInRow[indices[k]]++);
+            mWeightNonZero[j].push_back(1.f / (data[k] * data[k]));
+        }
+        mAPNonZero[j].resize(indices.size(), 0.f);
+    }
+}
+
+// the default uncertainty is 0.1 * D at the non-zeros, relative to beta that
+// is a weight of 1 / D^2, the uncertainty is matched to the non-zeros of the
+// data by walking the sorted indices of both
+void SparseNormalModel::setNonZeroUncertainty(const SparseMatrix &unc)
+{
+    GAPS_ASSERT(unc.nRow() == mDMatrix.nRow());
+    GAPS_ASSERT(unc.nCol() == mDMatrix.nCol());
+    mDefaultUncertainty = false;
+    for (unsigned j = 0; j < mDMatrix.nCol(); ++j)
+    {
+        const std::vector<unsigned> &indices(mDMatrix.getCol(j).getIndices());
+        const std::vector<unsigned> &uncIndices(unc.getCol(j).getIndices());
+        const std::vector<float> &uncData(unc.getCol(j).getData());
+        unsigned n = 0;
+        for (unsigned k = 0; k < indices.size(); ++k)
+        {
+            while (n < uncIndices.size() && uncIndices[n] < indices[k])
+            {
+                ++n;
+            }
+            if (n == uncIndices.size() || uncIndices[n] != indices[k])
+            {
+                GAPS_ERROR("uncertainty must be positive wherever the data is non-zero");
+            }
+            mWeightNonZero[j][k] = 1.f / (mBeta * uncData[n] * uncData[n]);
+        }
+    }
+}
+
 void SparseNormalModel::generateLookupTables()
 {
     unsigned nPatterns = mZ1.size();
     for (unsigned i = 0; i < nPatterns; ++i)
     {
-        mZ1[i] = 0.f;
-        for (unsigned k = 0; k < mOtherMatrix->nRow(); ++k)
+        for (unsigned j = i; j < nPatterns; ++j)
+        {
+            float d = gaps::dot(mOtherMatrix->getCol(i), mOtherMatrix->getCol(j));
+            mZ2(i,j) = d;
+            mZ2(j,i) = d;
+            mZ2Sum[i * nPatterns + j] = d;
+        }
+        mZ1[i] = mZ2(i,i);
+        mZ1Sum[i] = mZ1[i];
+    }
+}
+
+// Z2 is the product of the transpose of the other matrix with itself, so it
+// changes by y * y^T - x * x^T for each row of the other matrix that changed
+// from x to y, Z1 is its diagonal. The products of two floats are exact in
+// double precision, so keeping the tables in double precision stops rounding
+// errors from building up over many updates.
+void SparseNormalModel::updateLookupTables(const SparseNormalModel &model,
+const std::vector<unsigned> &changed)
+{
+    unsigned nPatterns = mZ1.size();
+    for (unsigned n = 0; n < changed.size(); ++n)
+    {
+        const float *x = model.mSyncedMatrix.getCol(changed[n]).ptr();
+        const float *y = model.mMatrix.getRow(changed[n]).ptr();
+        for (unsigned i = 0; i < nPatterns; ++i)
         {
-            mZ1[i] += GAPS_SQ(mOtherMatrix->operator()(k,i));
+            double xi = x[i];
+            double yi = y[i];
+            for (unsigned j = i; j < nPatterns; ++j)
+            {
+                mZ2Sum[i * nPatterns + j] += yi * y[j] - xi * x[j];
+            }
+            mZ1Sum[i] += yi * yi - xi * xi;
         }
+    }
+
+    for (unsigned i = 0; i < nPatterns; ++i)
+    {
+        mZ1[i] = static_cast<float>(mZ1Sum[i]);
         for (unsigned j = i; j < nPatterns; ++j)
         {
-            float d = gaps::dot(mOtherMatrix->getCol(i), mOtherMatrix->getCol(j));
+            float d = static_cast<float>(mZ2Sum[i * nPatterns + j]);
             mZ2(i,j) = d;
             mZ2(j,i) = d;
         }
     }
+
+#ifdef GAPS_DEBUG
+    // the tables are recomputed to check the drift, then restored so that
+    // debug builds sample the same way as release builds
+    Vector z1(mZ1);
+    Matrix z2(mZ2);
+    std::vector<double> z1Sum(mZ1Sum), z2Sum(mZ2Sum);
+    generateLookupTables();
+    float scale = 1.f + gaps::max(mZ1);
+    for (unsigned i = 0; i < nPatterns; ++i)
+    {
+        GAPS_ASSERT(std::abs(z1[i] - mZ1[i]) <= 0.0001f * scale);
+        for (unsigned j = 0; j < nPatterns; ++j)
+        {
+            GAPS_ASSERT(std::abs(z2(i,j) - mZ2(i,j)) <= 0.0001f * scale);
+        }
+    }
+    mZ1 = z1;
+    mZ2 = z2;
+    mZ1Sum = z1Sum;
+    mZ2Sum = z2Sum;
+#endif
 }
 
 Archive& operator<<(Archive &ar, const SparseNormalModel &m)
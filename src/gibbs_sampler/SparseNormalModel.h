@@ -3,12 +3,14 @@
 
 #include "AlphaParameters.h"
 #include "../GapsParameters.h"
+#include "../data_structures/HashSets.h"
 #include "../data_structures/HybridMatrix.h"
 #include "../data_structures/SparseMatrix.h"
 #include "../math/MatrixMath.h"
 #include "../utils/GapsPrint.h"
 
 #include <cmath>
+#include <vector>
 
 class GapsStatistics;
 class Archive;
@@ -25,8 +27,9 @@ public:
     void setMatrix(const Matrix &mat);
     void setAnnealingTemp(float temp);
     void sync(const SparseNormalModel &model, unsigned nThreads=1);
-    void extraInitialization();
-    float chiSq() const;
+    void extraInitialization(unsigned nThreads=1);
+    float chiSq(unsigned nThreads=1) const;
+    double takeChiSqChange();
     float dataSparsity() const;
     friend Archive& operator<<(Archive &ar, const SparseNormalModel &m);
     friend Archive& operator>>(Archive &ar, SparseNormalModel &m);
@@ -50,38 +53,59 @@ protected:
     SparseNormalModel(const SparseNormalModel&); // = delete (no c++11)
     SparseNormalModel& operator=(const SparseNormalModel&); // = delete (no c++11)
     void generateLookupTables();
+    void updateLookupTables(const SparseNormalModel &model,
+        const std::vector<unsigned> &changed);
     AlphaParameters alphaParameters(unsigned row, unsigned col);
     AlphaParameters alphaParameters(unsigned r1, unsigned c1, unsigned r2, unsigned c2);
     AlphaParameters alphaParametersWithChange(unsigned row, unsigned col, float ch);
+    void addChiSqChange(unsigned row, unsigned col, float delta);
+    void updateAPNonZero(unsigned row, unsigned col, float delta);
+    void indexNonZeros();
+    void setNonZeroUncertainty(const SparseMatrix &unc);
 
     SparseMatrix mDMatrix; // samples by genes for A, genes by samples for P
     HybridMatrix mMatrix; // genes by patterns for A, samples by patterns for P
     const HybridMatrix *mOtherMatrix; // pointer to P if this is A, and vice versa
+    std::vector< std::vector<float> > mAPNonZero; // AP at each non-zero of mDMatrix, in the same order
+    std::vector< std::vector<unsigned> > mTransposedPos; // position of each non-zero in the other model
+    std::vector< std::vector<float> > mWeightNonZero; // 1 / (beta * S^2) at each non-zero, 1 / D^2 by default
+    FixedHashSetU32 mChangedAPColumns; // changed since the other model synced
+    Matrix mSyncedMatrix; // transpose of mMatrix as last seen by the other model's lookup tables
     Matrix mZ2;
     Vector mZ1;
+    std::vector<double> mZ2Sum; // mZ2 in double precision for the updates
+    std::vector<double> mZ1Sum; // mZ1 in double precision for the updates
+    std::vector<double> mChiSqChange; // per row, empty unless tracking chi-square
     float mBeta;
     float mMaxGibbsMass;
     float mAnnealingTemp;
     float mLambda;
+    bool mDefaultUncertainty;
 };
 
 template <class DataType>
 SparseNormalModel::SparseNormalModel(const DataType &data, bool transpose,
 bool subsetRows, const GapsParameters &params, float alpha, float maxGibbsMass)
     :
-mDMatrix(data, transpose, subsetRows, params.dataIndicesSubset),
+mDMatrix(data, transpose, subsetRows, params.dataIndicesSubset, params.maxThreads),
 mMatrix(mDMatrix.nCol(), params.nPatterns),
 mOtherMatrix(NULL),
+mChangedAPColumns(mDMatrix.nCol()),
 mZ2(params.nPatterns, params.nPatterns),
 mZ1(params.nPatterns),
+mZ2Sum(params.nPatterns * params.nPatterns, 0.0),
+mZ1Sum(params.nPatterns, 0.0),
+mChiSqChange(params.trackChiSq ? mMatrix.nRow() : 0, 0.0),
 mBeta(100.f),
 mMaxGibbsMass(maxGibbsMass),
 mAnnealingTemp(1.f),
-mLambda(0.f)
+mLambda(0.f),
+mDefaultUncertainty(true)
 {
     float meanD = gaps::nonZeroMean(mDMatrix);
     mLambda = alpha * std::sqrt(nPatterns() / meanD);
     mMaxGibbsMass = mMaxGibbsMass / mLambda;
+    indexNonZeros();
 
     if (gaps::max(mDMatrix) > 50.f)
     {
@@ -89,12 +113,14 @@ mLambda(0.f)
     }
 }
 
-// required function for the GibbsSampler interface
+// only the uncertainty at the non-zeros of the data is used, the zeros always
+// have the default uncertainty of 0.1 so that they never need to be visited
 template <class DataType>
-void SparseNormalModel::setUncertainty(const DataType &data, bool transpose, // NOLINT
-bool subsetRows, const GapsParameters &params) // NOLINT
+void SparseNormalModel::setUncertainty(const DataType &unc, bool transpose,
+bool subsetRows, const GapsParameters &params)
 {
-    // nop - SparseGibbsSampler assumes default uncertainty always
+    setNonZeroUncertainty(SparseMatrix(unc, transpose, subsetRows,
+        params.dataIndicesSubset, params.maxThreads));
 }
 
 #endif // __COGAPS_SPARSE_NORMAL_MODEL_H__
\ No newline at end of file
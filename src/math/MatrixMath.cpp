@@ -1,7 +1,21 @@
 #include "VectorMath.h"
 #include "MatrixMath.h"
 #include "Math.h"
+#include "SIMDDispatch.h"
 #include "../data_structures/SparseIterator.h"
+#include "../utils/GapsAssert.h"
+
+#include <vector>
+
+// the transpose is done in square blocks small enough that the source and
+// destination of a block both stay in L1 cache
+#define GAPS_TRANSPOSE_BLOCK 64
+
+// the product is computed in blocks of rows of X that stay in L2 cache while
+// a block of columns of the result is computed from them, the row block must
+// be a multiple of SIMD_PAD_WIDTH so each part of a column stays aligned
+#define GAPS_GEMM_ROW_BLOCK 512
+#define GAPS_GEMM_COL_BLOCK 64
 
 float gaps::sparsity(const Matrix &mat)
 {
@@ -83,6 +97,117 @@ Matrix gaps::pmax(Matrix mat, float p)
     return mat;
 }
 
+// each block is split into tiles handled by the SIMD kernel, anything left at
+// the edges that doesn't fill a tile is copied one element at a time
+void gaps::transpose(const float *const *src, float *const *dst, unsigned nRow,
+unsigned nCol, unsigned nThreads)
+{
+    if (nRow == 0 || nCol == 0)
+    {
+        return;
+    }
+    unsigned nBlockCols = 1 + (nCol - 1) / GAPS_TRANSPOSE_BLOCK;
+    #pragma omp parallel for num_threads(nThreads)
+    for (unsigned b = 0; b < nBlockCols; ++b)
+    {
+        unsigned jBegin = b * GAPS_TRANSPOSE_BLOCK;
+        unsigned jEnd = gaps::min(jBegin + GAPS_TRANSPOSE_BLOCK, nCol);
+        unsigned jTileEnd = jBegin + (jEnd - jBegin) / GAPS_TRANSPOSE_TILE
+            * GAPS_TRANSPOSE_TILE;
+        for (unsigned iBegin = 0; iBegin < nRow; iBegin += GAPS_TRANSPOSE_BLOCK)
+        {
+            unsigned iEnd = gaps::min(iBegin + GAPS_TRANSPOSE_BLOCK, nRow);
+            unsigned iTileEnd = iBegin + (iEnd - iBegin) / GAPS_TRANSPOSE_TILE
+                * GAPS_TRANSPOSE_TILE;
+            for (unsigned j = jBegin; j < jTileEnd; j += GAPS_TRANSPOSE_TILE)
+            {
+                for (unsigned i = iBegin; i < iTileEnd; i += GAPS_TRANSPOSE_TILE)
+                {
+                    gaps::simd::kernels().transposeTile(src + j, i, dst + i, j);
+                }
+                for (unsigned jj = j; jj < j + GAPS_TRANSPOSE_TILE; ++jj)
+                {
+                    for (unsigned i = iTileEnd; i < iEnd; ++i)
+                    {
+                        dst[i][jj] = src[jj][i];
+                    }
+                }
+            }
+            for (unsigned j = jTileEnd; j < jEnd; ++j)
+            {
+                for (unsigned i = iBegin; i < iEnd; ++i)
+                {
+                    dst[i][j] = src[j][i];
+                }
+            }
+        }
+    }
+}
+
+void gaps::transpose(const Matrix &src, Matrix *dst, unsigned nThreads)
+{
+    GAPS_ASSERT(src.nRow() == dst->nCol());
+    GAPS_ASSERT(src.nCol() == dst->nRow());
+    if (src.nRow() == 0 || src.nCol() == 0)
+    {
+        return;
+    }
+    std::vector<const float*> srcCols(src.nCol());
+    for (unsigned j = 0; j < src.nCol(); ++j)
+    {
+        srcCols[j] = src.getCol(j).ptr();
+    }
+    std::vector<float*> dstCols(dst->nCol());
+    for (unsigned j = 0; j < dst->nCol(); ++j)
+    {
+        dstCols[j] = dst->getCol(j).ptr();
+    }
+    gaps::transpose(&srcCols[0], &dstCols[0], src.nRow(), src.nCol(), nThreads);
+}
+
+// the rows of Y are transposed first so the coefficients for each column of
+// the result are contiguous
+void gaps::multiplyTransposed(const Matrix &X, const Matrix &Y, Matrix *C,
+unsigned nThreads)
+{
+    GAPS_ASSERT(X.nCol() == Y.nCol());
+    GAPS_ASSERT(C->nRow() == X.nRow());
+    GAPS_ASSERT(C->nCol() == Y.nRow());
+    GAPS_ASSERT(X.nCol() > 0);
+    unsigned nRow = X.nRow();
+    unsigned nCol = Y.nRow();
+    unsigned nInner = X.nCol();
+    if (nRow == 0 || nCol == 0)
+    {
+        return;
+    }
+    Matrix Yt(nInner, nCol);
+    gaps::transpose(Y, &Yt, nThreads);
+
+    unsigned nBlockCols = 1 + (nCol - 1) / GAPS_GEMM_COL_BLOCK;
+    #pragma omp parallel for num_threads(nThreads)
+    for (unsigned b = 0; b < nBlockCols; ++b)
+    {
+        unsigned jBegin = b * GAPS_GEMM_COL_BLOCK;
+        unsigned jEnd = gaps::min(jBegin + GAPS_GEMM_COL_BLOCK, nCol);
+        std::vector<const float*> xCols(nInner);
+        for (unsigned iBegin = 0; iBegin < nRow; iBegin += GAPS_GEMM_ROW_BLOCK)
+        {
+            unsigned size = gaps::min(nRow - iBegin,
+                static_cast<unsigned>(GAPS_GEMM_ROW_BLOCK));
+            for (unsigned k = 0; k < nInner; ++k)
+            {
+                xCols[k] = X.getCol(k).ptr() + iBegin;
+            }
+            for (unsigned j = jBegin; j < jEnd; ++j)
+            {
+                gaps::simd::kernels().linearCombination(&xCols[0],
+                    Yt.getCol(j).ptr(), nInner, C->getCol(j).ptr() + iBegin, size);
+            }
+        }
+    }
+}
+
 Matrix operator*(Matrix mat, float f)
 {
     for (unsigned j = 0; j < mat.nCol(); ++j)
@@ -25,6 +25,17 @@ namespace gaps
     template <class MatrixType>
     float mean(const MatrixType &mat);
     Matrix pmax(Matrix mat, float p);
+
+    // dst(j,i) = src(i,j) where src is nRow x nCol and both matrices are
+    // given as pointers to their columns
+    void transpose(const float *const *src, float *const *dst, unsigned nRow,
+        unsigned nCol, unsigned nThreads=1);
+    void transpose(const Matrix &src, Matrix *dst, unsigned nThreads=1);
+
+    // C = X * Y^T, every element is accumulated in the same order regardless
+    // of which factor comes first, so multiplyTransposed(Y, X) is exactly C^T
+    void multiplyTransposed(const Matrix &X, const Matrix &Y, Matrix *C,
+        unsigned nThreads=1);
 } // namespace gaps
 
 Matrix operator*(Matrix mat, float f);
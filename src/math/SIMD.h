@@ -1,14 +1,69 @@
 #ifndef __COGAPS_SIMD_H__
 #define __COGAPS_SIMD_H__
 
-#if defined(_WIN32) || defined(WIN32) || defined(__MINGW32__)
+#include "SIMDDispatch.h"
+
+// all vectors are padded to a multiple of this many floats, so the kernels
+// can use full width loads with the widest instruction set that can be
+// dispatched to in this build
+#if defined(GAPS_SIMD_DISPATCH) && !defined(GAPS_DISABLE_AVX)
+    #define SIMD_PAD_WIDTH 16 // AVX-512
+#elif defined(GAPS_SIMD_DISPATCH)
+    #define SIMD_PAD_WIDTH 4 // SSE
+#else
+    #define SIMD_PAD_WIDTH 1 // scalar
+#endif
+
+#if defined(_WIN32) || defined(WIN32) || defined(__MINGW32__) || defined(GAPS_DISABLE_SIMD)
     #define COGAPS_SIMD_H_DISABLE_SIMD
 #endif
 
-#if (defined ( __AVX2__ ) || defined ( __AVX__ )) && !defined(COGAPS_SIMD_H_DISABLE_SIMD)
+// The instruction set is normally chosen from the compiler flags. The files
+// compiling the dispatched kernels (SIMDKernels*.cpp) choose it instead by
+// defining one of GAPS_SIMD_USE_AVX512, GAPS_SIMD_USE_AVX, GAPS_SIMD_USE_SSE
+// or GAPS_SIMD_USE_SCALAR before including this file.
+#if !defined(GAPS_SIMD_USE_AVX512) && !defined(GAPS_SIMD_USE_AVX) \
+    && !defined(GAPS_SIMD_USE_SSE) && !defined(GAPS_SIMD_USE_SCALAR)
+    #if defined(COGAPS_SIMD_H_DISABLE_SIMD)
+        #define GAPS_SIMD_USE_SCALAR
+    #elif defined ( __AVX512F__ )
+        #define GAPS_SIMD_USE_AVX512
+    #elif defined ( __AVX2__ ) || defined ( __AVX__ )
+        #define GAPS_SIMD_USE_AVX
+    #elif defined ( __SSE4_2__ ) || defined ( __SSE4_1__ )
+        #define GAPS_SIMD_USE_SSE
+    #else
+        #define GAPS_SIMD_USE_SCALAR
+    #endif
+#endif
+
+#include <stdint.h>
+#include <cstring>
+
+// FMA_PACKED(a,b,c) computes a * b + c, with a single rounding when fused
+// multiply-add instructions are available
+
+#if defined(GAPS_SIMD_USE_AVX512)
+
+    #define SIMD_INC 16
+    #define __GAPS_AVX512__
+    #define GAPS_SIMD_NAMESPACE avx512
+    #include <immintrin.h>
+    typedef __m512 gaps_packed_t;
+    #define SET_SCALAR(x) _mm512_set1_ps(x)
+    #define LOAD_PACKED(x) _mm512_load_ps(x)
+    #define STORE_PACKED(p,x) _mm512_store_ps(p,x)
+    #define ADD_PACKED(a,b) _mm512_add_ps(a,b)
+    #define SUB_PACKED(a,b) _mm512_sub_ps(a,b)
+    #define MUL_PACKED(a,b) _mm512_mul_ps(a,b)
+    #define DIV_PACKED(a,b) _mm512_div_ps(a,b)
+    #define FMA_PACKED(a,b,c) _mm512_fmadd_ps(a,b,c)
+
+#elif defined(GAPS_SIMD_USE_AVX)
 
     #define SIMD_INC 8
     #define __GAPS_AVX__
+    #define GAPS_SIMD_NAMESPACE avx
     #include <immintrin.h>
     typedef __m256 gaps_packed_t;
     #define SET_SCALAR(x) _mm256_set1_ps(x)
@@ -18,11 +73,18 @@
     #define SUB_PACKED(a,b) _mm256_sub_ps(a,b)
     #define MUL_PACKED(a,b) _mm256_mul_ps(a,b)
     #define DIV_PACKED(a,b) _mm256_div_ps(a,b)
+    #if defined ( __FMA__ ) || defined(GAPS_SIMD_USE_FMA)
+        #define __GAPS_FMA__
+        #define FMA_PACKED(a,b,c) _mm256_fmadd_ps(a,b,c)
+    #else
+        #define FMA_PACKED(a,b,c) _mm256_add_ps(_mm256_mul_ps(a,b),c)
+    #endif
 
-#elif (defined ( __SSE4_2__ ) || defined ( __SSE4_1__ )) && !defined(COGAPS_SIMD_H_DISABLE_SIMD)
+#elif defined(GAPS_SIMD_USE_SSE)
 
     #define SIMD_INC 4
     #define __GAPS_SSE__
+    #define GAPS_SIMD_NAMESPACE sse
     #include <nmmintrin.h>
     typedef __m128 gaps_packed_t;
     #define SET_SCALAR(x) _mm_set1_ps(x)
@@ -32,11 +94,13 @@
     #define SUB_PACKED(a,b) _mm_sub_ps(a,b)
     #define MUL_PACKED(a,b) _mm_mul_ps(a,b)
     #define DIV_PACKED(a,b) _mm_div_ps(a,b)
+    #define FMA_PACKED(a,b,c) _mm_add_ps(_mm_mul_ps(a,b),c)
 
 #else
 
     typedef float gaps_packed_t;
     #define SIMD_INC 1
+    #define GAPS_SIMD_NAMESPACE scalar
     #define SET_SCALAR(x) x
     #define LOAD_PACKED(x) *(x)
     #define STORE_PACKED(p,x) *(p) = (x)
@@ -44,13 +108,18 @@
     #define SUB_PACKED(a,b) ((a)-(b))
     #define MUL_PACKED(a,b) ((a)*(b))
     #define DIV_PACKED(a,b) ((a)/(b))
+    #define FMA_PACKED(a,b,c) ((a)*(b)+(c))
 
 #endif
 
+// everything is defined in a namespace named after the instruction set, so
+// the kernels compiled for different instruction sets don't collide
 namespace gaps
 {
 namespace simd
 {
+namespace GAPS_SIMD_NAMESPACE
+{
 
 class Index
 {
@@ -60,7 +129,7 @@ public:
     Index& operator=(unsigned val) { index = val; return *this; }
     bool operator<(unsigned comp) const { return index < comp; }
     bool operator<=(unsigned comp) const { return index <= comp; }
-    void operator++() { index += gaps::simd::Index::increment(); }
+    void operator++() { index += Index::increment(); }
     unsigned value() const { return index; }
     
     static unsigned increment()
@@ -70,6 +139,7 @@ public:
 
     friend const float* operator+(const float *ptr, Index ndx);
     friend float* operator+(float *ptr, Index ndx);
+    friend const uint16_t* operator+(const uint16_t *ptr, Index ndx);
 
 private:
 
@@ -78,6 +148,71 @@ private:
 
 inline const float* operator+(const float *ptr, Index ndx) { return ptr + ndx.index; }
 inline float* operator+(float *ptr, Index ndx) { return ptr + ndx.index; }
+inline const uint16_t* operator+(const uint16_t *ptr, Index ndx) { return ptr + ndx.index; }
+
+// horizontal sum of all elements, the halves are added together with
+// shuffles instead of hadd, which is slower on most processors
+inline float getScalar(gaps_packed_t pf)
+{
+    #if defined( __GAPS_AVX512__ )
+        return _mm512_reduce_add_ps(pf);
+    #elif defined( __GAPS_AVX__ )
+        __m128 sum = _mm_add_ps(_mm256_castps256_ps128(pf), _mm256_extractf128_ps(pf, 1));
+        sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+        sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+        return _mm_cvtss_f32(sum);
+    #elif defined( __GAPS_SSE__ )
+        __m128 sum = _mm_add_ps(pf, _mm_movehl_ps(pf, pf));
+        sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+        return _mm_cvtss_f32(sum);
+    #else
+        return pf;
+    #endif
+}
+
+// same as above but the elements are added in double precision
+inline double getScalarDouble(gaps_packed_t pf)
+{
+    #if defined( __GAPS_AVX512__ )
+        __m512d lo = _mm512_cvtps_pd(_mm512_castps512_ps256(pf));
+        __m512d hi = _mm512_cvtps_pd(_mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(pf), 1)));
+        return _mm512_reduce_add_pd(_mm512_add_pd(lo, hi));
+    #elif defined( __GAPS_AVX__ )
+        __m256d sum = _mm256_add_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(pf)),
+            _mm256_cvtps_pd(_mm256_extractf128_ps(pf, 1)));
+        __m128d half = _mm_add_pd(_mm256_castpd256_pd128(sum), _mm256_extractf128_pd(sum, 1));
+        return _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+    #elif defined( __GAPS_SSE__ )
+        __m128d sum = _mm_add_pd(_mm_cvtps_pd(pf), _mm_cvtps_pd(_mm_movehl_ps(pf, pf)));
+        return _mm_cvtsd_f64(_mm_add_sd(sum, _mm_unpackhi_pd(sum, sum)));
+    #else
+        return static_cast<double>(pf);
+    #endif
+}
+
+// bfloat16 values are the upper 16 bits of a float, so they are widened by
+// moving them into the upper half of each 32 bit lane
+inline gaps_packed_t loadBfloat16(const uint16_t *ptr)
+{
+    #if defined( __GAPS_AVX512__ )
+        __m512i wide = _mm512_cvtepu16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr)));
+        return _mm512_castsi512_ps(_mm512_slli_epi32(wide, 16));
+    #elif defined( __GAPS_AVX__ )
+        // 256 bit integer instructions need AVX2, so each half is widened separately
+        __m128i half = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+        __m128 lo = _mm_castsi128_ps(_mm_unpacklo_epi16(_mm_setzero_si128(), half));
+        __m128 hi = _mm_castsi128_ps(_mm_unpackhi_epi16(_mm_setzero_si128(), half));
+        return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+    #elif defined( __GAPS_SSE__ )
+        __m128i half = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(ptr));
+        return _mm_castsi128_ps(_mm_unpacklo_epi16(_mm_setzero_si128(), half));
+    #else
+        uint32_t bits = static_cast<uint32_t>(*ptr) << 16;
+        float val = 0.f;
+        std::memcpy(&val, &bits, sizeof(float));
+        return val;
+    #endif
+}
 
 class PackedFloat
 {
@@ -85,7 +220,7 @@ public:
 
     PackedFloat() : mData(SET_SCALAR(0.f)) {}
     explicit PackedFloat(float val) : mData(SET_SCALAR(val)) {}
-#if defined( __GAPS_SSE__ ) || defined( __GAPS_AVX__ ) // avoid redefintion when gaps_packed_t == float
+#if defined( __GAPS_SSE__ ) || defined( __GAPS_AVX__ ) || defined( __GAPS_AVX512__ ) // avoid redefintion when gaps_packed_t == float
     explicit PackedFloat(gaps_packed_t val) : mData(val) {}
 #endif
 
@@ -95,44 +230,21 @@ public:
     PackedFloat operator/(PackedFloat b) const { return PackedFloat(DIV_PACKED(mData, b.mData)); }
 
     void operator+=(PackedFloat val) { mData = ADD_PACKED(mData, val.mData); }
+    void fmadd(PackedFloat a, PackedFloat b) { mData = FMA_PACKED(a.mData, b.mData, mData); } // += a * b
     void load(const float *ptr) { mData = LOAD_PACKED(ptr); }
+    void load(const uint16_t *ptr) { mData = loadBfloat16(ptr); } // bfloat16
     void store(float *ptr) { STORE_PACKED(ptr, mData); }
 
-    float scalar()
-    {
-    #if defined( __GAPS_AVX__ )
-        float* ra = reinterpret_cast<float*>(&mData); // NOLINT
-        mData = _mm256_hadd_ps(mData, mData);
-        mData = _mm256_hadd_ps(mData, mData);
-        return ra[0] + ra[4];
-    #elif defined( __GAPS_SSE__ )
-        float* ra = reinterpret_cast<float*>(&mData); // NOLINT
-        return ra[0] + ra[1] + ra[2] + ra[3];
-    #else
-        return mData;
-    #endif
-    }
+    float scalar() const { return getScalar(mData); }
+    double scalarDouble() const { return getScalarDouble(mData); }
 
 private:
 
     gaps_packed_t mData;
 };
 
-inline float getScalar(gaps_packed_t pf)
-{
-    #if defined( __GAPS_AVX__ )
-        pf = _mm256_hadd_ps(pf, pf);
-        pf = _mm256_hadd_ps(pf, pf);
-        float* ra = reinterpret_cast<float*>(&pf); // NOLINT
-        return ra[0] + ra[4];
-    #elif defined( __GAPS_SSE__ )
-        float* ra = reinterpret_cast<float*>(&pf); // NOLINT
-        return ra[0] + ra[1] + ra[2] + ra[3];
-    #else
-        return pf;
-    #endif
-}
-
+} // namespace GAPS_SIMD_NAMESPACE
+using namespace GAPS_SIMD_NAMESPACE;
 } // namespace simd
 } // namespace gaps
 
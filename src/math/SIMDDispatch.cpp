@@ -0,0 +1,91 @@
+// the scalar kernels are compiled here, the others in SIMDKernels*.cpp
+#define GAPS_SIMD_USE_SCALAR
+#include "SIMDKernels.h"
+
+// constant initialized, so the scalar kernels can be used even while other
+// files are being initialized
+gaps::simd::KernelTable gaps::simd::gKernels =
+{
+    kernelDot,
+    kernelDotDiff,
+    kernelAlphaParameters<float>,
+    kernelAlphaParametersDiff<float>,
+    kernelAlphaParametersWithChange<float>,
+    kernelAlphaParametersPair<float>,
+    kernelAlphaParameters<uint16_t>,
+    kernelAlphaParametersDiff<uint16_t>,
+    kernelAlphaParametersWithChange<uint16_t>,
+    kernelAlphaParametersPair<uint16_t>,
+    kernelAddScaled,
+    kernelAddScaledChiSq<float>,
+    kernelAddScaledChiSq<uint16_t>,
+    kernelChiSq<float>,
+    kernelChiSq<uint16_t>,
+    kernelTransposeTile,
+    kernelLinearCombination,
+    gaps::simd::INSTRUCTION_SET_SCALAR
+};
+
+// switch to the widest instruction set when the library is loaded
+static const bool gKernelsSelected = gaps::simd::setInstructionSet(
+    gaps::simd::bestInstructionSet());
+
+gaps::simd::KernelTable gaps::simd::scalarKernels()
+{
+    return makeKernelTable(INSTRUCTION_SET_SCALAR);
+}
+
+// cpu features are queried directly since the library may run on a different
+// machine than the one it was compiled on, AVX kernels also use FMA
+gaps::simd::InstructionSet gaps::simd::bestInstructionSet()
+{
+#ifdef GAPS_SIMD_DISPATCH
+    __builtin_cpu_init();
+#ifndef GAPS_DISABLE_AVX
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        return INSTRUCTION_SET_AVX512;
+    }
+    if (__builtin_cpu_supports("avx") && __builtin_cpu_supports("fma"))
+    {
+        return INSTRUCTION_SET_AVX;
+    }
+#endif
+    if (__builtin_cpu_supports("sse4.1"))
+    {
+        return INSTRUCTION_SET_SSE;
+    }
+#endif
+    return INSTRUCTION_SET_SCALAR;
+}
+
+// returns false and keeps the current kernels if the instruction set is not
+// supported, any set narrower than the best one can be selected
+bool gaps::simd::setInstructionSet(InstructionSet set)
+{
+    if (set > bestInstructionSet())
+    {
+        return false;
+    }
+    switch (set)
+    {
+#ifdef GAPS_SIMD_DISPATCH
+        case INSTRUCTION_SET_AVX512: gKernels = avx512Kernels(); break;
+        case INSTRUCTION_SET_AVX:    gKernels = avxKernels();    break;
+        case INSTRUCTION_SET_SSE:    gKernels = sseKernels();    break;
+#endif
+        default:                     gKernels = scalarKernels(); break;
+    }
+    return true;
+}
+
+std::string gaps::simd::instructionSetName(InstructionSet set)
+{
+    switch (set)
+    {
+        case INSTRUCTION_SET_AVX512: return "AVX-512 (with FMA)";
+        case INSTRUCTION_SET_AVX:    return "AVX (with FMA)";
+        case INSTRUCTION_SET_SSE:    return "SSE";
+        default:                     return "scalar";
+    }
+}
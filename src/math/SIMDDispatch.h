@@ -0,0 +1,116 @@
+#ifndef __COGAPS_SIMD_DISPATCH_H__
+#define __COGAPS_SIMD_DISPATCH_H__
+
+#include <stdint.h>
+#include <string>
+
+// Kernels for the wider instruction sets are only compiled when the compiler
+// can target an instruction set for part of a file and the cpu can be queried
+// at runtime. Otherwise only the scalar kernels are available.
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__)) \
+    && !defined(_WIN32) && !defined(WIN32) && !defined(__MINGW32__) && !defined(GAPS_DISABLE_SIMD)
+    #define GAPS_SIMD_DISPATCH
+#endif
+
+// size of the square tiles the transpose kernel works on
+#define GAPS_TRANSPOSE_TILE 8
+
+namespace gaps
+{
+namespace simd
+{
+
+enum InstructionSet
+{
+    INSTRUCTION_SET_SCALAR = 0,
+    INSTRUCTION_SET_SSE = 1,
+    INSTRUCTION_SET_AVX = 2, // AVX with FMA
+    INSTRUCTION_SET_AVX512 = 3
+};
+
+// The performance critical loops. Each instruction set has its own version of
+// these, the widest one supported by the cpu is selected the first time the
+// kernels are used. All vectors passed in must be padded to SIMD_PAD_WIDTH.
+// The alpha parameter kernels take W = 1 / S^2 rather than the uncertainty S
+// so that they multiply instead of divide.
+struct KernelTable
+{
+    float (*dot)(const float *v1, const float *v2, unsigned size);
+    float (*dotDiff)(const float *v1, const float *v2, const float *v3,
+        unsigned size); // v1 * (v2 - v3)
+    void (*alphaParameters)(const float *mat, const float *D, const float *W,
+        const float *AP, unsigned size, float *s, float *s_mu);
+    void (*alphaParametersDiff)(const float *mat1, const float *mat2,
+        const float *D, const float *W, const float *AP, unsigned size,
+        float *s, float *s_mu); // same as above with mat = mat1 - mat2
+    void (*alphaParametersWithChange)(const float *mat, const float *D,
+        const float *W, const float *AP, float ch, unsigned size, float *s,
+        float *s_mu);
+    void (*alphaParametersPair)(const float *mat1, const float *D1,
+        const float *W1, const float *AP1, const float *mat2, const float *D2,
+        const float *W2, const float *AP2, unsigned size, float *s,
+        float *s_mu); // two columns in one pass
+
+    // same as above with D and W stored as bfloat16
+    void (*alphaParametersBf16)(const float *mat, const uint16_t *D,
+        const uint16_t *W, const float *AP, unsigned size, float *s,
+        float *s_mu);
+    void (*alphaParametersDiffBf16)(const float *mat1, const float *mat2,
+        const uint16_t *D, const uint16_t *W, const float *AP, unsigned size,
+        float *s, float *s_mu);
+    void (*alphaParametersWithChangeBf16)(const float *mat, const uint16_t *D,
+        const uint16_t *W, const float *AP, float ch, unsigned size, float *s,
+        float *s_mu);
+    void (*alphaParametersPairBf16)(const float *mat1, const uint16_t *D1,
+        const uint16_t *W1, const float *AP1, const float *mat2,
+        const uint16_t *D2, const uint16_t *W2, const float *AP2,
+        unsigned size, float *s, float *s_mu);
+
+    void (*addScaled)(float *y, const float *x, float a, unsigned size); // y += a * x
+
+    // AP += delta * mat, returns the change in the sum of W * (D - AP)^2
+    double (*addScaledChiSq)(float *AP, const float *mat, float delta,
+        const float *D, const float *W, unsigned size);
+    double (*addScaledChiSqBf16)(float *AP, const float *mat, float delta,
+        const uint16_t *D, const uint16_t *W, unsigned size);
+
+    // sum of W * (D - AP)^2, each lane is summed with Kahan summation and the
+    // lanes are added in double precision
+    double (*chiSq)(const float *D, const float *W, const float *AP, unsigned size);
+    double (*chiSqBf16)(const uint16_t *D, const uint16_t *W, const float *AP,
+        unsigned size);
+
+    // transposes one tile, dst[i][dstRow + j] = src[j][srcRow + i] for i and j
+    // less than GAPS_TRANSPOSE_TILE, these don't need to be padded or aligned
+    void (*transposeTile)(const float *const *src, unsigned srcRow,
+        float *const *dst, unsigned dstRow);
+
+    // c = sum of coef[k] * cols[k] over the nCols columns, every element is
+    // accumulated in order of k so the product of two matrices is exactly the
+    // transpose of the product with the factors swapped
+    void (*linearCombination)(const float *const *cols, const float *coef,
+        unsigned nCols, float *c, unsigned size);
+    InstructionSet instructionSet;
+};
+
+// selected at startup, the scalar kernels are used before that
+extern KernelTable gKernels;
+inline const KernelTable& kernels() { return gKernels; }
+
+InstructionSet bestInstructionSet();
+bool setInstructionSet(InstructionSet set); // not thread safe
+std::string instructionSetName(InstructionSet set);
+
+// kernels compiled for each instruction set, these can only be called if the
+// instruction set is supported by the cpu
+KernelTable scalarKernels();
+#ifdef GAPS_SIMD_DISPATCH
+KernelTable sseKernels();
+KernelTable avxKernels();
+KernelTable avx512Kernels();
+#endif
+
+} // namespace simd
+} // namespace gaps
+
+#endif // __COGAPS_SIMD_DISPATCH_H__
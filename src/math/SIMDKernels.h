@@ -0,0 +1,411 @@
+#ifndef __COGAPS_SIMD_KERNELS_H__
+#define __COGAPS_SIMD_KERNELS_H__
+
+// The bodies of the dispatched kernels. This file is included once by each
+// of the files compiling the kernels for one instruction set, after SIMD.h has
+// been configured for it. Everything here has internal linkage so the copies
+// for different instruction sets never collide.
+
+#include "SIMD.h"
+#include "SIMDDispatch.h"
+
+namespace
+{
+
+// this function is frequently called small vectors and represents a significant bottleneck,
+// this code falls through the switch statement to avoid the overhead of branching,
+// supported vectors have to be padded with 0 so that the length is a multiple of SIMD_INC
+float kernelDot(const float *v1, const float *v2, unsigned size)
+{
+    unsigned nChunks = 1 + (size - 1) / SIMD_INC;
+    gaps_packed_t pDot(SET_SCALAR(0.f));
+    switch (nChunks)
+    {
+        case 25:
+            pDot = FMA_PACKED(LOAD_PACKED(v1 + 24 * SIMD_INC), LOAD_PACKED(v2 + 24 * SIMD_INC), pDot);
+            // fall through
+        case 24:
+            pDot = FMA_PACKED(LOAD_PACKED(v1 + 23 * SIMD_INC), LOAD_PACKED(v2 + 23 * SIMD_INC), pDot);
+            // fall through
+        case 23:
+            pDot = FMA_PACKED(LOAD_PACKED(v1 + 22 * SIMD_INC), LOAD_PACKED(v2 + 22 * SIMD_INC), pDot);
+            // fall through
+        case 22:
+            pDot = FMA_PACKED(LOAD_PACKED(v1 + 21 * SIMD_INC), LOAD_PACKED(v2 + 21 * SIMD_INC), pDot);
+            // fall through
+        case 21:
+            pDot = FMA_PACKED(LOAD_PACKED(v1 + 20 * SIMD_INC), LOAD_PACKED(v2 + 20 * SIMD_INC), pDot);
+            // fall through
+        case 20:
+            pDot = FMA_PACKED(LOAD_PACKED(v1 + 19 * SIMD_INC), LOAD_PACKED(v2 + 19 * SIMD_INC), pDot);
+            // fall through
+        case 19:
+            pDot = FMA_PACKED(LOAD_PACKED(v1 + 18 * SIMD_INC), LOAD_PACKED(v2 + 18 * SIMD_INC), pDot);
+            // fall through
+        case 18:
+            pDot = FMA_PACKED(LOAD_PACKED(v1 + 17 * SIMD_INC), LOAD_PACKED(v2 + 17 * SIMD_INC), pDot);
+            // fall through
+        case 17:
+            pDot = FMA_PACKED(LOAD_PACKED(v1 + 16 * SIMD_INC), LOAD_PACKED(v2 + 16 * SIMD_INC), pDot);
+            // fall through
+        case 16:
+            pDot = FMA_PACKED(LOAD_PACKED(v1 + 15 * SIMD_INC), LOAD_PACKED(v2 + 15 * SIMD_INC), pDot);
+            // fall through
+        case 15:
+            pDot = FMA_PACKED(LOAD_PACKED(v1 + 14 * SIMD_INC), LOAD_PACKED(v2 + 14 * SIMD_INC), pDot);
+            // fall through
+        case 14:
+            pDot = FMA_PACKED(LOAD_PACKED(v1 + 13 * SIMD_INC), LOAD_PACKED(v2 + 13 * SIMD_INC), pDot);
+            // fall through
+        case 13:
+            pDot = FMA_PACKED(LOAD_PACKED(v1 + 12 * SIMD_INC), LOAD_PACKED(v2 + 12 * SIMD_INC), pDot);
+            // fall through
+        case 12:
+            pDot = FMA_PACKED(LOAD_PACKED(v1 + 11 * SIMD_INC), LOAD_PACKED(v2 + 11 * SIMD_INC), pDot);
+            // fall through
+        case 11:
+            pDot = FMA_PACKED(LOAD_PACKED(v1 + 10 * SIMD_INC), LOAD_PACKED(v2 + 10 * SIMD_INC), pDot);
+            // fall through
+        case 10:
+            pDot = FMA_PACKED(LOAD_PACKED(v1 + 9 * SIMD_INC), LOAD_PACKED(v2 + 9 * SIMD_INC), pDot);
+            // fall through
+        case 9:
+            pDot = FMA_PACKED(LOAD_PACKED(v1 + 8 * SIMD_INC), LOAD_PACKED(v2 + 8 * SIMD_INC), pDot);
+            // fall through
+        case 8:
+            pDot = FMA_PACKED(LOAD_PACKED(v1 + 7 * SIMD_INC), LOAD_PACKED(v2 + 7 * SIMD_INC), pDot);
+            // fall through
+        case 7:
+            pDot = FMA_PACKED(LOAD_PACKED(v1 + 6 * SIMD_INC), LOAD_PACKED(v2 + 6 * SIMD_INC), pDot);
+            // fall through
+        case 6:
+            pDot = FMA_PACKED(LOAD_PACKED(v1 + 5 * SIMD_INC), LOAD_PACKED(v2 + 5 * SIMD_INC), pDot);
+            // fall through
+        case 5:
+            pDot = FMA_PACKED(LOAD_PACKED(v1 + 4 * SIMD_INC), LOAD_PACKED(v2 + 4 * SIMD_INC), pDot);
+            // fall through
+        case 4:
+            pDot = FMA_PACKED(LOAD_PACKED(v1 + 3 * SIMD_INC), LOAD_PACKED(v2 + 3 * SIMD_INC), pDot);
+            // fall through
+        case 3:
+            pDot = FMA_PACKED(LOAD_PACKED(v1 + 2 * SIMD_INC), LOAD_PACKED(v2 + 2 * SIMD_INC), pDot);
+            // fall through
+        case 2:
+            pDot = FMA_PACKED(LOAD_PACKED(v1 + SIMD_INC), LOAD_PACKED(v2 + SIMD_INC), pDot);
+            // fall through
+        case 1:
+            pDot = FMA_PACKED(LOAD_PACKED(v1), LOAD_PACKED(v2), pDot);
+            break;    
+        default:
+            for (unsigned i = 0; i < size; i += SIMD_INC)
+            {
+                pDot = FMA_PACKED(LOAD_PACKED(v1 + i), LOAD_PACKED(v2 + i), pDot);
+            }
+            break;
+    }
+    return gaps::simd::getScalar(pDot);
+}
+
+float kernelDotDiff(const float *v1, const float *v2, const float *v3, unsigned size)
+{
+    gaps::simd::PackedFloat packedDot(0.f), p1, p2, p3;
+    for (unsigned i = 0; i < size; i += SIMD_INC)
+    {
+        p1.load(v1 + i);
+        p2.load(v2 + i);
+        p3.load(v3 + i);
+        packedDot.fmadd(p1, p2 - p3);
+    }
+    return packedDot.scalar();
+}
+
+// the data and uncertainty can be stored as float or bfloat16 (uint16_t), the
+// kernels are the same since PackedFloat::load widens bfloat16
+
+template <class T>
+void kernelAlphaParameters(const float *mat, const T *D, const T *W,
+const float *AP, unsigned size, float *s, float *s_mu)
+{
+    gaps::simd::PackedFloat pMat, pD, pAP, pW;
+    gaps::simd::PackedFloat partialS(0.f), partialS_mu(0.f);
+    for (gaps::simd::Index i(0); i < size; ++i)
+    {   
+        pMat.load(mat + i);
+        pD.load(D + i);
+        pAP.load(AP + i);
+        pW.load(W + i);
+        gaps::simd::PackedFloat ratio(pMat * pW);
+        partialS.fmadd(pMat, ratio);
+        partialS_mu.fmadd(ratio, pD - pAP);
+    }
+    *s = partialS.scalar();
+    *s_mu = partialS_mu.scalar();
+}
+
+template <class T>
+void kernelAlphaParametersDiff(const float *mat1, const float *mat2,
+const T *D, const T *W, const float *AP, unsigned size, float *s,
+float *s_mu)
+{
+    gaps::simd::PackedFloat pMat1, pMat2, pD, pAP, pW;
+    gaps::simd::PackedFloat packedS(0.f), packedS_mu(0.f);
+    for (gaps::simd::Index i(0); i < size; ++i)
+    {   
+        pMat1.load(mat1 + i);
+        pMat2.load(mat2 + i);
+        pD.load(D + i);
+        pAP.load(AP + i);
+        pW.load(W + i);
+        gaps::simd::PackedFloat diff(pMat1 - pMat2);
+        gaps::simd::PackedFloat ratio(diff * pW);
+        packedS.fmadd(diff, ratio);
+        packedS_mu.fmadd(ratio, pD - pAP);
+    }
+    *s = packedS.scalar();
+    *s_mu = packedS_mu.scalar();
+}
+
+template <class T>
+void kernelAlphaParametersWithChange(const float *mat, const T *D,
+const T *W, const float *AP, float ch, unsigned size, float *s, float *s_mu)
+{
+    gaps::simd::PackedFloat pCh(ch);
+    gaps::simd::PackedFloat pMat, pD, pAP, pW;
+    gaps::simd::PackedFloat packedS(0.f), packedS_mu(0.f);
+    for (gaps::simd::Index i(0); i < size; ++i)
+    {   
+        pMat.load(mat + i);
+        pD.load(D + i);
+        pAP.load(AP + i);
+        pW.load(W + i);
+        gaps::simd::PackedFloat ratio(pMat * pW);
+        pAP.fmadd(pCh, pMat);
+        packedS.fmadd(pMat, ratio);
+        packedS_mu.fmadd(ratio, pD - pAP);
+    }
+    *s = packedS.scalar();
+    *s_mu = packedS_mu.scalar();
+}
+
+// alpha parameters for moving mass between two different rows of the matrix,
+// the same as adding the parameters of each column (note the minus sign in
+// AlphaParameters::operator+) but both columns are read in a single pass
+template <class T>
+void kernelAlphaParametersPair(const float *mat1, const T *D1,
+const T *W1, const float *AP1, const float *mat2, const T *D2,
+const T *W2, const float *AP2, unsigned size, float *s, float *s_mu)
+{
+    gaps::simd::PackedFloat pMat1, pD1, pW1, pAP1, pMat2, pD2, pW2, pAP2;
+    gaps::simd::PackedFloat packedS(0.f), packedS_mu1(0.f), packedS_mu2(0.f);
+    for (gaps::simd::Index i(0); i < size; ++i)
+    {
+        pMat1.load(mat1 + i);
+        pD1.load(D1 + i);
+        pW1.load(W1 + i);
+        pAP1.load(AP1 + i);
+        pMat2.load(mat2 + i);
+        pD2.load(D2 + i);
+        pW2.load(W2 + i);
+        pAP2.load(AP2 + i);
+        gaps::simd::PackedFloat ratio1(pMat1 * pW1);
+        gaps::simd::PackedFloat ratio2(pMat2 * pW2);
+        packedS.fmadd(pMat1, ratio1);
+        packedS.fmadd(pMat2, ratio2);
+        packedS_mu1.fmadd(ratio1, pD1 - pAP1);
+        packedS_mu2.fmadd(ratio2, pD2 - pAP2);
+    }
+    *s = packedS.scalar();
+    *s_mu = packedS_mu1.scalar() - packedS_mu2.scalar();
+}
+
+void kernelAddScaled(float *y, const float *x, float a, unsigned size)
+{
+    gaps::simd::PackedFloat pX, pY;
+    gaps::simd::PackedFloat pA(a);
+    for (gaps::simd::Index i(0); i < size; ++i)
+    {
+        pX.load(x + i);
+        pY.load(y + i);
+        pY.fmadd(pA, pX);
+        pY.store(y + i);
+    }
+}
+
+// the change in W * (D - AP)^2 is W * (old - new) * (2D - old - new), which
+// doesn't lose precision when the change is small compared to the residual
+template <class T>
+double kernelAddScaledChiSq(float *AP, const float *mat, float delta,
+const T *D, const T *W, unsigned size)
+{
+    gaps::simd::PackedFloat pMat, pAP, pNewAP, pD, pW;
+    gaps::simd::PackedFloat pDelta(delta), change(0.f);
+    for (gaps::simd::Index i(0); i < size; ++i)
+    {
+        pMat.load(mat + i);
+        pAP.load(AP + i);
+        pD.load(D + i);
+        pW.load(W + i);
+        pNewAP = pAP;
+        pNewAP.fmadd(pDelta, pMat);
+        pNewAP.store(AP + i);
+        change += pW * (pAP - pNewAP) * (pD + pD - pAP - pNewAP);
+    }
+    return change.scalarDouble();
+}
+
+// the compensation is subtracted at the end since it holds the negated error
+template <class T>
+double kernelChiSq(const T *D, const T *W, const float *AP, unsigned size)
+{
+    gaps::simd::PackedFloat pD, pW, pAP;
+    gaps::simd::PackedFloat sum(0.f), compensation(0.f);
+    for (gaps::simd::Index i(0); i < size; ++i)
+    {
+        pD.load(D + i);
+        pW.load(W + i);
+        pAP.load(AP + i);
+        gaps::simd::PackedFloat diff(pD - pAP);
+        gaps::simd::PackedFloat term(diff * diff * pW - compensation);
+        gaps::simd::PackedFloat total(sum + term);
+        compensation = (total - sum) - term;
+        sum = total;
+    }
+    return sum.scalarDouble() - compensation.scalarDouble();
+}
+
+// the 8 x 8 tile is transposed in registers with the usual unpack, shuffle and
+// permute sequence, the AVX-512 kernels use it as well since a 16 x 16 tile
+// is larger than most of the matrices this is used on are wide
+void kernelTransposeTile(const float *const *src, unsigned srcRow,
+float *const *dst, unsigned dstRow)
+{
+#if defined( __GAPS_AVX__ ) || defined( __GAPS_AVX512__ )
+    __m256 r0 = _mm256_loadu_ps(src[0] + srcRow);
+    __m256 r1 = _mm256_loadu_ps(src[1] + srcRow);
+    __m256 r2 = _mm256_loadu_ps(src[2] + srcRow);
+    __m256 r3 = _mm256_loadu_ps(src[3] + srcRow);
+    __m256 r4 = _mm256_loadu_ps(src[4] + srcRow);
+    __m256 r5 = _mm256_loadu_ps(src[5] + srcRow);
+    __m256 r6 = _mm256_loadu_ps(src[6] + srcRow);
+    __m256 r7 = _mm256_loadu_ps(src[7] + srcRow);
+
+    __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+    __m256 t1 = _mm256_unpackhi_ps(r0, r1);
+    __m256 t2 = _mm256_unpacklo_ps(r2, r3);
+    __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+    __m256 t4 = _mm256_unpacklo_ps(r4, r5);
+    __m256 t5 = _mm256_unpackhi_ps(r4, r5);
+    __m256 t6 = _mm256_unpacklo_ps(r6, r7);
+    __m256 t7 = _mm256_unpackhi_ps(r6, r7);
+
+    r0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1,0,1,0));
+    r1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3,2,3,2));
+    r2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1,0,1,0));
+    r3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3,2,3,2));
+    r4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1,0,1,0));
+    r5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3,2,3,2));
+    r6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1,0,1,0));
+    r7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3,2,3,2));
+
+    _mm256_storeu_ps(dst[0] + dstRow, _mm256_permute2f128_ps(r0, r4, 0x20));
+    _mm256_storeu_ps(dst[1] + dstRow, _mm256_permute2f128_ps(r1, r5, 0x20));
+    _mm256_storeu_ps(dst[2] + dstRow, _mm256_permute2f128_ps(r2, r6, 0x20));
+    _mm256_storeu_ps(dst[3] + dstRow, _mm256_permute2f128_ps(r3, r7, 0x20));
+    _mm256_storeu_ps(dst[4] + dstRow, _mm256_permute2f128_ps(r0, r4, 0x31));
+    _mm256_storeu_ps(dst[5] + dstRow, _mm256_permute2f128_ps(r1, r5, 0x31));
+    _mm256_storeu_ps(dst[6] + dstRow, _mm256_permute2f128_ps(r2, r6, 0x31));
+    _mm256_storeu_ps(dst[7] + dstRow, _mm256_permute2f128_ps(r3, r7, 0x31));
+#elif defined( __GAPS_SSE__ )
+    // four 4 x 4 tiles
+    for (unsigned bj = 0; bj < GAPS_TRANSPOSE_TILE; bj += 4)
+    {
+        for (unsigned bi = 0; bi < GAPS_TRANSPOSE_TILE; bi += 4)
+        {
+            __m128 r0 = _mm_loadu_ps(src[bj + 0] + srcRow + bi);
+            __m128 r1 = _mm_loadu_ps(src[bj + 1] + srcRow + bi);
+            __m128 r2 = _mm_loadu_ps(src[bj + 2] + srcRow + bi);
+            __m128 r3 = _mm_loadu_ps(src[bj + 3] + srcRow + bi);
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            _mm_storeu_ps(dst[bi + 0] + dstRow + bj, r0);
+            _mm_storeu_ps(dst[bi + 1] + dstRow + bj, r1);
+            _mm_storeu_ps(dst[bi + 2] + dstRow + bj, r2);
+            _mm_storeu_ps(dst[bi + 3] + dstRow + bj, r3);
+        }
+    }
+#else
+    for (unsigned j = 0; j < GAPS_TRANSPOSE_TILE; ++j)
+    {
+        for (unsigned i = 0; i < GAPS_TRANSPOSE_TILE; ++i)
+        {
+            dst[i][dstRow + j] = src[j][srcRow + i];
+        }
+    }
+#endif
+}
+
+// four independent accumulators hide the latency of the multiply-add, the
+// last few elements are done one vector at a time
+void kernelLinearCombination(const float *const *cols, const float *coef,
+unsigned nCols, float *c, unsigned size)
+{
+    unsigned i = 0;
+    for (; i + 4 * SIMD_INC <= size; i += 4 * SIMD_INC)
+    {
+        gaps::simd::PackedFloat c0, c1, c2, c3, x;
+        for (unsigned k = 0; k < nCols; ++k)
+        {
+            gaps::simd::PackedFloat y(coef[k]);
+            const float *col = cols[k] + i;
+            x.load(col);
+            c0.fmadd(y, x);
+            x.load(col + SIMD_INC);
+            c1.fmadd(y, x);
+            x.load(col + 2 * SIMD_INC);
+            c2.fmadd(y, x);
+            x.load(col + 3 * SIMD_INC);
+            c3.fmadd(y, x);
+        }
+        c0.store(c + i);
+        c1.store(c + i + SIMD_INC);
+        c2.store(c + i + 2 * SIMD_INC);
+        c3.store(c + i + 3 * SIMD_INC);
+    }
+    for (; i < size; i += SIMD_INC)
+    {
+        gaps::simd::PackedFloat c0, x;
+        for (unsigned k = 0; k < nCols; ++k)
+        {
+            x.load(cols[k] + i);
+            c0.fmadd(gaps::simd::PackedFloat(coef[k]), x);
+        }
+        c0.store(c + i);
+    }
+}
+
+gaps::simd::KernelTable makeKernelTable(gaps::simd::InstructionSet set)
+{
+    gaps::simd::KernelTable table;
+    table.dot = kernelDot;
+    table.dotDiff = kernelDotDiff;
+    table.alphaParameters = kernelAlphaParameters<float>;
+    table.alphaParametersDiff = kernelAlphaParametersDiff<float>;
+    table.alphaParametersWithChange = kernelAlphaParametersWithChange<float>;
+    table.alphaParametersPair = kernelAlphaParametersPair<float>;
+    table.alphaParametersBf16 = kernelAlphaParameters<uint16_t>;
+    table.alphaParametersDiffBf16 = kernelAlphaParametersDiff<uint16_t>;
+    table.alphaParametersWithChangeBf16 = kernelAlphaParametersWithChange<uint16_t>;
+    table.alphaParametersPairBf16 = kernelAlphaParametersPair<uint16_t>;
+    table.addScaled = kernelAddScaled;
+    table.addScaledChiSq = kernelAddScaledChiSq<float>;
+    table.addScaledChiSqBf16 = kernelAddScaledChiSq<uint16_t>;
+    table.chiSq = kernelChiSq<float>;
+    table.chiSqBf16 = kernelChiSq<uint16_t>;
+    table.transposeTile = kernelTransposeTile;
+    table.linearCombination = kernelLinearCombination;
+    table.instructionSet = set;
+    return table;
+}
+
+} // anonymous namespace
+
+#endif // __COGAPS_SIMD_KERNELS_H__
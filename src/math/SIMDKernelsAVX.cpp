@@ -0,0 +1,31 @@
+// AVX kernels, compiled for this instruction set regardless of the
+// compiler flags and only used if the cpu supports it
+#include "SIMDDispatch.h"
+
+#ifdef GAPS_SIMD_DISPATCH
+
+#include <immintrin.h>
+
+#if defined(__clang__)
+    #pragma clang attribute push (__attribute__((target("avx,fma"))), apply_to = function)
+#else
+    #pragma GCC push_options
+    #pragma GCC target("avx,fma")
+#endif
+
+#define GAPS_SIMD_USE_AVX
+#define GAPS_SIMD_USE_FMA
+#include "SIMDKernels.h"
+
+gaps::simd::KernelTable gaps::simd::avxKernels()
+{
+    return makeKernelTable(INSTRUCTION_SET_AVX);
+}
+
+#if defined(__clang__)
+    #pragma clang attribute pop
+#else
+    #pragma GCC pop_options
+#endif
+
+#endif // GAPS_SIMD_DISPATCH
@@ -0,0 +1,38 @@
+// AVX-512 kernels, compiled for this instruction set regardless of the
+// compiler flags and only used if the cpu supports it
+#include "SIMDDispatch.h"
+
+#ifdef GAPS_SIMD_DISPATCH
+
+// some versions of gcc warn about the undefined values used inside the
+// AVX-512 intrinsics, e.g. in _mm512_reduce_add_ps
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+#include <immintrin.h>
+
+#if defined(__clang__)
+    #pragma clang attribute push (__attribute__((target("avx512f,fma"))), apply_to = function)
+#else
+    #pragma GCC push_options
+    #pragma GCC target("avx512f,fma")
+#endif
+
+#define GAPS_SIMD_USE_AVX512
+#include "SIMDKernels.h"
+
+gaps::simd::KernelTable gaps::simd::avx512Kernels()
+{
+    return makeKernelTable(INSTRUCTION_SET_AVX512);
+}
+
+#if defined(__clang__)
+    #pragma clang attribute pop
+#else
+    #pragma GCC pop_options
+#endif
+
+#pragma GCC diagnostic pop
+
+#endif // GAPS_SIMD_DISPATCH
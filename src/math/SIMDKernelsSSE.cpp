@@ -0,0 +1,30 @@
+// SSE kernels, compiled for this instruction set regardless of the
+// compiler flags and only used if the cpu supports it
+#include "SIMDDispatch.h"
+
+#ifdef GAPS_SIMD_DISPATCH
+
+#include <immintrin.h>
+
+#if defined(__clang__)
+    #pragma clang attribute push (__attribute__((target("sse4.1"))), apply_to = function)
+#else
+    #pragma GCC push_options
+    #pragma GCC target("sse4.1")
+#endif
+
+#define GAPS_SIMD_USE_SSE
+#include "SIMDKernels.h"
+
+gaps::simd::KernelTable gaps::simd::sseKernels()
+{
+    return makeKernelTable(INSTRUCTION_SET_SSE);
+}
+
+#if defined(__clang__)
+    #pragma clang attribute pop
+#else
+    #pragma GCC pop_options
+#endif
+
+#endif // GAPS_SIMD_DISPATCH
@@ -1,7 +1,7 @@
 #ifndef __COGAPS_GLOBAL_CONFIG_H__
 #define __COGAPS_GLOBAL_CONFIG_H__
 
-#include "../math/SIMD.h"
+#include "../math/SIMDDispatch.h"
 
 #include <string>
 
@@ -36,13 +36,11 @@ inline std::string buildReport()
     std::string compiler = "Compiled with Microsoft Visual Studio\n";
 #endif
 
-#if defined( __GAPS_AVX__ )
-    std::string simd = "SIMD: AVX instructions enabled\n";
-#elif defined( __GAPS_SSE__ )
-    std::string simd = "SIMD: SSE instructions enabled\n";
-#else
-    std::string simd = "SIMD not enabled\n";
-#endif
+    // the kernels are chosen when the library is loaded
+    gaps::simd::InstructionSet set = gaps::simd::kernels().instructionSet;
+    std::string simd = (set == gaps::simd::INSTRUCTION_SET_SCALAR)
+        ? "SIMD not enabled\n"
+        : "SIMD: " + gaps::simd::instructionSetName(set) + " instructions selected at runtime\n";
 
 #ifdef __GAPS_OPENMP__
     std::string openmp = "Compiled with OpenMP\n";